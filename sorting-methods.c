@@ -1,8 +1,38 @@
+#define _GNU_SOURCE  // For O_DIRECT
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>  // For sleep() function
 #include <string.h>  // For string manipulation
+#include <pthread.h> // For the parallel sorts' thread pool
+#include <sched.h>   // For sched_yield()
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <termios.h>
+
+// AVX2 sorting kernels are compiled on x86-64 unless built with -DNO_SIMD;
+// they are still only used when the CPU reports AVX2 at runtime
+#if defined(__x86_64__) && !defined(NO_SIMD)
+#define HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Build: gcc -O2 -pthread sorting-methods.c -o sorting-methods -lm
 
 // ANSI color codes for better visualization
 #define RED     "\x1b[31m"
@@ -23,20 +53,759 @@ void mergeSort(int arr[], int left, int right, int visualize);
 void merge(int arr[], int left, int mid, int right, int visualize);
 void quickSort(int arr[], int low, int high, int visualize);
 int partition(int arr[], int low, int high, int visualize);
+void introSort(int arr[], int n, int visualize);
+void pdqSort(int arr[], int n);
+void bottomUpMergeSort(int arr[], int n, int scratch[]);
+void inPlaceMergeSort(int arr[], int n);
+void mergeRuns(int src[], int dest[], int left, int mid, int right);
+void timSort(int arr[], int n, int scratch[]);
+int nthElement(int arr[], int n, int k);
+void topK(const int arr[], int n, int k, int out[]);
+void partialSort(int arr[], int n, int k);
+void parallelMergeSort(int arr[], int n, int threads);
+void countingSort(int arr[], int n);
+void radixSort(int arr[], int n, int digit_bits, int scratch[]);
+void radixSort64(long long arr[], int n, long long scratch[]);
+
+// Type-specialized sorts. DEFINE_TYPED_SORTS (below main) instantiates an
+// introsort and a stable bottom-up merge sort per element type, with the
+// comparison expanded inline instead of called through a function pointer.
+typedef struct {
+    long long key;
+    long long payload;
+} KeyPayload;
+
+typedef struct {
+    long long key;
+    int index;
+} KeyIndex;
+
+#define DECLARE_TYPED_SORTS(SUFFIX, TYPE) \
+    void introSort##SUFFIX(TYPE arr[], int n); \
+    void stableSort##SUFFIX(TYPE arr[], int n, TYPE scratch[]);
+
+DECLARE_TYPED_SORTS(Int64, long long)
+DECLARE_TYPED_SORTS(UInt32, unsigned int)
+DECLARE_TYPED_SORTS(Float, float)
+DECLARE_TYPED_SORTS(Double, double)
+DECLARE_TYPED_SORTS(Record, KeyPayload)
+DECLARE_TYPED_SORTS(KeyIndex, KeyIndex)
+void argsortInt64(const long long keys[], int index[], int n);
+int simdAvailable();
+void simdSortSmall(int arr[], int n);
+void simdMergeSort(int arr[], int n, int scratch[]);
+void multiwayMergeSort(int arr[], int n, int scratch[]);
+void parallelQuickSort(int arr[], int n, int threads);
+void insertionSortRange(int arr[], int low, int high);
+void heapSortRange(int arr[], int low, int high);
+int medianOfThree(int arr[], int a, int b, int c);
+void partition3Way(int arr[], int low, int high, int pivot, int *lt, int *gt, int traced);
 void printArray(int arr[], int n);
 void copyArray(int source[], int dest[], int n);
-void visualizeSort(int arr[], int n, int index1, int index2, const char* sortName, int color);
-void printProgressBar(float progress, int width);
+void visualizeBegin(int n);
+void visualizeAlgorithm(int algorithm, int arr[], int n);
+void printProgressBar(FILE *out, float progress, int width, const char *status);
 void printMenu();
 void printHeader();
 void printComparisonChart(double times[], const char* names[], int num_sorts);
 void printLegend();
+void printTableRule(int columns);
+double timeSort(void (*sort)(int arr[], int n), int source[], int work[], int n);
+void runSelectionSort(int arr[], int n);
+void runBubbleSort(int arr[], int n);
+void runMergeSort(int arr[], int n);
+void runQuickSort(int arr[], int n);
+void runIntroSort(int arr[], int n);
+void runBottomUpMergeSort(int arr[], int n);
+void runParallelMergeSort(int arr[], int n);
+void runParallelQuickSort(int arr[], int n);
+void runCountingSort(int arr[], int n);
+void runRadixSort(int arr[], int n);
+void runRadixSort11(int arr[], int n);
+void runSimdMergeSort(int arr[], int n);
+void runTimSort(int arr[], int n);
+void runPdqSort(int arr[], int n);
+void runMultiwayMergeSort(int arr[], int n);
+double nowSeconds();
+int interactiveMenu();
 
 // Global variables for visualization
 int visualization_speed = 50000; // microseconds delay
 int visualize_enabled = 1;
+int visualization_fps = 30;      // Frame rate cap; steps between frames are coalesced
+
+#define VIZ_MAX_ROWS 40      // Larger arrays are bucketed into this many bars
+#define VIZ_BAR_WIDTH 50
+#define VIZ_ROW_BYTES 512    // Room for a full-width bar of 3-byte glyphs plus escapes
+#define VIZ_FIRST_ROW 11     // Screen row of the first bar, below the header and title
+#define REPLAY_MAX_SECONDS 60  // Default replay speed plays any trace within this time
+
+// Algorithms timed by the comparison and performance analysis modes
+typedef struct {
+    const char *name;   // Short name used in tables and charts
+    const char *key;    // Name used by --algos on the command line
+    const char *color;  // ANSI color used for the chart bar
+    void (*sort)(int arr[], int n);
+} SortAlgorithm;
+
+SortAlgorithm algorithms[] = {
+    {"Selection",  "selection", YELLOW,  runSelectionSort},
+    {"Bubble",     "bubble",    GREEN,   runBubbleSort},
+    {"Merge",      "merge",     BLUE,    runMergeSort},
+    {"Quick",      "quick",     MAGENTA, runQuickSort},
+    {"Intro",      "intro",     CYAN,    runIntroSort},
+    {"BU Merge",   "bumerge",   BLUE,    runBottomUpMergeSort},
+    {"Par Merge",  "parmerge",  BLUE,    runParallelMergeSort},
+    {"Par Quick",  "parquick",  MAGENTA, runParallelQuickSort},
+    {"Counting",   "counting",  GREEN,   runCountingSort},
+    {"Radix",      "radix",     YELLOW,  runRadixSort},
+    {"AVX2 Merge", "avx2merge", CYAN,    runSimdMergeSort},
+    {"TimSort",    "timsort",   GREEN,   runTimSort},
+    {"PDQ",        "pdq",       MAGENTA, runPdqSort},
+    {"Multiway",   "multiway",  BLUE,    runMultiwayMergeSort},
+};
+int num_algorithms = sizeof(algorithms) / sizeof(algorithms[0]);
+
+// Input distributions produced by generateInput()
+typedef enum {
+    DIST_UNIFORM,        // Uniform over the full 32-bit range
+    DIST_SORTED,
+    DIST_REVERSED,
+    DIST_NEARLY_SORTED,  // Sorted, then n/100 random swaps
+    DIST_FEW_UNIQUE,     // FEW_UNIQUE_VALUES distinct values
+    DIST_ORGAN_PIPE,     // Ascending first half, descending second half
+    DIST_SAWTOOTH,       // Ascending runs of about sqrt(n) elements
+    DIST_ZIPF,           // Zipf(s = 1) over ZIPF_KEYS ranks
+    NUM_DISTRIBUTIONS
+} Distribution;
+
+const char *distribution_names[NUM_DISTRIBUTIONS] = {
+    "Uniform", "Sorted", "Reversed", "Nearly", "Few uniq", "Organ", "Sawtooth", "Zipf"
+};
+const char *distribution_keys[NUM_DISTRIBUTIONS] = {
+    "uniform", "sorted", "reversed", "nearly", "fewunique", "organpipe", "sawtooth", "zipf"
+};
+
+// Seed for every generated input; set with --seed or the settings menu
+uint64_t input_seed = 0;
+
+// xoshiro256** state, seeded through splitmix64
+typedef struct {
+    uint64_t s[4];
+} Xoshiro256;
+
+void prngSeed(Xoshiro256 *rng, uint64_t seed);
+uint64_t prngNext(Xoshiro256 *rng);
+uint32_t prngBounded(Xoshiro256 *rng, uint32_t bound);
+void generateInput(int arr[], size_t n, Distribution dist, uint64_t seed);
+int distributionFromKey(const char *key);
+int isImpracticalRun(int algorithm, Distribution dist, int n);
+
+// Element types compared by the type-specialized sort table
+enum {
+    TYPED_INT64,
+    TYPED_UINT32,
+    TYPED_FLOAT,
+    TYPED_DOUBLE,
+    TYPED_RECORD,
+    TYPED_ARGSORT,
+    NUM_TYPED_BENCHMARKS
+};
+
+const char *typed_benchmark_names[NUM_TYPED_BENCHMARKS] = {
+    "int64", "uint32", "float", "double+NaN", "key+payload", "argsort"
+};
+
+int timeTypedSorts(int type, int n, double *qsort_time, double *intro_time, double *stable_time);
+
+// Scratch memory for the sort functions. Requests are bumped off one
+// arena that is reset before every run and grown between runs to the
+// largest peak seen, so the timed region makes no allocator calls; blocks
+// are released in reverse order of allocation. Requests that do not fit
+// fall back to malloc. Only the calling thread may allocate scratch.
+#define SCRATCH_ALIGN 64
+#define SCRATCH_SLACK (64 << 10)    // Reserved beyond n ints for counts and small buffers
+
+typedef struct {
+    char *base;
+    size_t capacity, used;
+    size_t heap_live;       // Bytes currently held in malloc fallbacks
+    size_t high_water;      // Largest peak over all runs; the next reset grows to it
+    long allocations;       // Scratch requests in the current run
+    long heap_allocations;  // Requests that did not fit the arena
+    size_t bytes;           // Bytes requested in the current run
+    size_t peak;            // Peak live scratch in the current run
+} ScratchArena;
+
+ScratchArena scratch_arena = {0};
+long long max_scratch_bytes = -1;   // Scratch limit per run, -1 for none (--max-scratch)
+
+void *scratchAlloc(size_t bytes);
+void *scratchCalloc(size_t count, size_t size);
+void scratchFree(void *block);
+int scratchFits(size_t bytes);
+void scratchReset(size_t expected);
+long peakRssKB();
+
+// Operation counters, compiled in with -DCOUNT_OPERATIONS. They are
+// thread-local, so the parallel sorts only report the calling thread's share.
+typedef struct {
+    long long comparisons;
+    long long swaps;
+    long long moves;
+} OperationCounts;
+
+#ifdef COUNT_OPERATIONS
+static __thread OperationCounts op_counts;
+#define COUNT_COMPARISONS(k) ((void)(op_counts.comparisons += (k)))
+#define COUNT_SWAPS(k) ((void)(op_counts.swaps += (k)))
+#define COUNT_MOVES(k) ((void)(op_counts.moves += (k)))
+#else
+#define COUNT_COMPARISONS(k) ((void)0)
+#define COUNT_SWAPS(k) ((void)0)
+#define COUNT_MOVES(k) ((void)0)
+#endif
+
+// Operation trace for visualization. The traceable sorts are written once as
+// TRACEABLE bodies taking a constant `traced` flag and instantiated twice:
+// the plain copy timed by the benchmarks has no trace code at all, and the
+// traced copy appends compare/swap/write events to a preallocated buffer that
+// is spilled to a binary trace file. -DNO_TRACE compiles recording out.
+#define TRACEABLE static inline __attribute__((always_inline))
+
+enum { TRACE_OP_COMPARE, TRACE_OP_SWAP, TRACE_OP_WRITE };
+
+typedef struct {
+    int32_t op;
+    int32_t a, b;   // Compared or swapped indices; for writes the index and new value
+    int32_t old;    // Value a write replaced, so replay can step backwards
+} TraceEvent;
+
+#define TRACE_BUFFER_EVENTS 65536
+
+TraceEvent *trace_events = NULL;   // Buffer being filled; NULL when not recording
+size_t trace_fill = 0;
+void traceSpill();
+
+static inline void traceRecord(int op, int a, int b, int old) {
+    if (!trace_events) return;
+    TraceEvent *e = &trace_events[trace_fill];
+    e->op = op;
+    e->a = a;
+    e->b = b;
+    e->old = old;
+    if (++trace_fill == TRACE_BUFFER_EVENTS) traceSpill();
+}
+
+#ifndef NO_TRACE
+#define TRACE_COMPARE(traced, i, j) ((traced) ? traceRecord(TRACE_OP_COMPARE, (i), (j), 0) : (void)0)
+#define TRACE_SWAP(traced, i, j) ((traced) ? traceRecord(TRACE_OP_SWAP, (i), (j), 0) : (void)0)
+#define TRACE_WRITE(traced, arr, i, value) \
+    ((traced) ? traceRecord(TRACE_OP_WRITE, (i), (value), (arr)[i]) : (void)0)
+#else
+#define TRACE_COMPARE(traced, i, j) ((void)(traced))
+#define TRACE_SWAP(traced, i, j) ((void)(traced))
+#define TRACE_WRITE(traced, arr, i, value) ((void)(traced))
+#endif
+
+// Hardware counters read through perf_event_open; unavailable events
+// (no permission, no PMU in a VM) are reported as missing. Page faults
+// come from the kernel's software counter and work without a PMU.
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_PAGE_FAULTS,
+    NUM_PERF_EVENTS
+};
+
+typedef struct {
+    long long values[NUM_PERF_EVENTS];
+    int valid[NUM_PERF_EVENTS];
+} PerfSample;
+
+// Everything measured for one sort run
+typedef struct {
+    double seconds;
+    PerfSample perf;
+    OperationCounts ops;
+    long allocations;       // Scratch requests
+    size_t scratch_bytes;   // Scratch bytes requested
+    size_t peak_scratch;    // Peak live scratch bytes
+} SortMeasurement;
+
+const char *perf_event_names[NUM_PERF_EVENTS] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "dtlb_misses", "page_faults"
+};
+int perf_fds[NUM_PERF_EVENTS] = {-2, -2, -2, -2, -2, -2, -2};  // -2 = not opened yet
+
+void measureSort(void (*sort)(int arr[], int n), int source[], int work[], int n, SortMeasurement *m);
+int perfAvailable();
+void perfStart();
+void perfStop(PerfSample *sample);
+double comparisonsPerNLogN(long long comparisons, int n);
+
+// Performance analysis mode measures counters on at most this many elements
+#define COUNTER_MAX_SIZE 10000
+
+// Introsort tuning
+#define INSERTION_SORT_THRESHOLD 16   // Ranges smaller than this use insertion sort
+#define NINTHER_THRESHOLD 128         // Ranges at least this large use Tukey's ninther
+
+// Pattern-defeating quicksort: insertion sort below INSERTION_THRESHOLD,
+// blocks of BLOCK_SIZE offsets per partition step (offsets fit in a byte)
+// and at most PARTIAL_INSERTION_LIMIT moves when finishing a partition
+// that was already in order
+#define PDQ_INSERTION_THRESHOLD 24
+#define PDQ_BLOCK_SIZE 64
+#define PDQ_PARTIAL_INSERTION_LIMIT 8
+
+// Bottom-up merge sort: blocks of this size are insertion sorted before merging
+#define MERGE_RUN_SIZE 32
+
+// TimSort: arrays below MIN_MERGE use binary insertion sort only, merges
+// start galloping after MIN_GALLOP consecutive wins by one run, and the
+// run stack stays far below MAX_RUNS since run lengths grow like Fibonacci
+#define TIMSORT_MIN_MERGE 64
+#define TIMSORT_MIN_GALLOP 7
+#define TIMSORT_MAX_RUNS 85
+
+// Parallel sorts: ranges below the cutoff are sorted sequentially, and
+// quick sort partitions ranges of at least PARALLEL_PARTITION_MIN in parallel
+#define PARALLEL_CUTOFF 8192
+#define PARALLEL_PARTITION_MIN (1 << 20)
+#define DEQUE_CAPACITY 1024
+
+// Input generation: chunk size for per-chunk generator streams, size from
+// which chunks are generated in parallel, and distribution parameters
+#define GENERATOR_CHUNK (1 << 16)
+#define PARALLEL_GENERATE_MIN (1 << 20)
+#define FEW_UNIQUE_VALUES 16
+#define ZIPF_KEYS (1 << 16)
+
+// Lomuto quick sort recurses O(n) deep on patterned inputs; beyond this
+// size those runs are skipped instead of overflowing the stack
+#define LOMUTO_MAX_PATTERN_SIZE 100000
+
+// Counting sort is used when max - min is at most this; radix sort otherwise
+#define COUNTING_SORT_MAX_SPAN (1 << 20)
+// Radix sort switches from 8-bit to 11-bit digits at this many elements
+#define RADIX11_MIN_SIZE (1 << 20)
+
+// AVX2 hybrid merge sort: blocks of this size are sorted by the sorting network
+#define SIMD_BLOCK_SIZE 64
+
+// Data cache sizes in bytes, read from sysfs at startup (--cache overrides);
+// the defaults are used for levels sysfs does not report
+typedef struct {
+    size_t l1d, l2, llc;
+} CacheSizes;
+
+CacheSizes cache_sizes = {32 << 10, 256 << 10, 8 << 20};
+
+void detectCacheSizes();
+int parseCacheSizes(const char *list);
+
+// Multiway merge sort merges at most this many runs per pass
+#define MULTIWAY_MAX_FANIN 256
+
+// Number of threads used by the parallel sorts (0 = one per online CPU)
+int num_threads = 0;
+
+// Work-stealing thread pool. Each worker owns a deque: it pushes and pops
+// tasks at the bottom while idle workers steal from the top. The calling
+// thread acts as worker 0, so a pool of N threads starts N - 1 pthreads.
+typedef struct {
+    void (*run)(void *arg);
+    void *arg;
+    atomic_int done;
+} PoolTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask *tasks[DEQUE_CAPACITY];
+    int head;   // Index of the oldest task (stolen first)
+    int count;
+} WorkDeque;
+
+typedef struct {
+    int num_workers;
+    WorkDeque *deques;
+    pthread_t *threads;
+    pthread_mutex_t state_lock;
+    pthread_cond_t state_cond;
+    atomic_int active;   // Nonzero while poolRun() is executing a job
+    int shutdown;
+} ThreadPool;
+
+ThreadPool pool = {0};
+static __thread int worker_index = 0;
+
+void poolInit(int threads);
+void poolShutdown();
+void poolRun(void (*run)(void *arg), void *arg, int threads);
+void poolSpawn(PoolTask *task, void (*run)(void *arg), void *arg);
+void poolWait(PoolTask *task);
+
+// Non-interactive benchmark mode (--bench)
+#define BENCH_MAX_SIZES 64
+
+typedef enum { FORMAT_TABLE, FORMAT_CSV, FORMAT_JSON } BenchFormat;
+
+typedef struct {
+    int enabled;
+    int selected[sizeof(algorithms) / sizeof(algorithms[0])];
+    int sizes[BENCH_MAX_SIZES];
+    int num_sizes;
+    int distributions[NUM_DISTRIBUTIONS];
+    int reps;
+    int warmup;
+    BenchFormat format;
+    int selection;          // Run the selection benchmark instead (--select)
+    int complexity;         // Run the complexity analysis instead (--complexity)
+    const char *baseline_path;  // Also save the samples to this baseline file (--save-baseline)
+    const char *compare_path;   // Rerun and compare against this baseline instead (--compare)
+    double threshold;           // Regression in percent that fails --compare
+    int jobs;                   // Run repetitions as concurrent pinned jobs (--jobs)
+} BenchConfig;
+
+// Timing summary of one (algorithm, size) cell
+typedef struct {
+    double min, median, p95, mean, stddev;
+    double elements_per_second;
+} BenchStats;
+
+int parseAlgorithmList(const char *list, BenchConfig *config);
+int parseSizeList(const char *list, BenchConfig *config);
+int parseDistributionList(const char *list, BenchConfig *config);
+
+// External merge sort of a binary int32/int64 file (--external)
+#define EXTERNAL_MAX_FANIN 256
+#define EXTERNAL_MIN_BUFFER (64 * 1024)
+#define DIRECT_IO_ALIGN 4096
+
+typedef struct {
+    const char *input_path;
+    const char *output_path;
+    int element_size;       // 4 for int32, 8 for int64
+    size_t memory_budget;   // Bytes for run buffers and merge buffers
+    int direct_io;          // Write the output with O_DIRECT
+} ExternalSortConfig;
+
+int externalSort(ExternalSortConfig *config);
 
-int main() {
+// String sorting (--strings): a string with the next 8 bytes from the
+// current depth cached beside its pointer
+typedef struct {
+    uint64_t key;
+    const unsigned char *str;
+} StringRef;
+
+#define STRING_INSERTION_THRESHOLD 16   // Multikey quicksort
+#define MSD_INSERTION_THRESHOLD 32      // MSD radix sort
+
+void multikeyQuickSort(StringRef a[], int n);
+void msdRadixSortStrings(StringRef a[], int n);
+void mergeSortStrings(const char *a[], int n);
+
+// Large-array mode (--large): 64-bit indexing throughout, buffers mapped
+// on 2 MB boundaries with huge pages requested, and first touch spread
+// over the thread pool so pages are distributed across NUMA nodes
+#define LARGE_PAGE_SIZE ((size_t)2 << 20)
+#define LARGE_RADIX_BITS 11
+#define LARGE_MAX_PARTS 256   // Slices per array for the parallel kernels
+
+void pdqSortLarge(int arr[], size_t n);
+void *largeAlloc(size_t bytes, const char **page_kind);
+void largeFree(void *block, size_t bytes);
+void largeFirstTouch(int a[], int b[], size_t n);
+void largeRadixSort(int arr[], size_t n, int scratch[]);
+
+// Batched sorting of many short arrays (--batch). Array i of a batch is
+// values[offsets[i]..offsets[i + 1]) of one flat buffer (CSR layout).
+#define BATCH_CLASSES 7             // Up to 8, 16, 32, 64, 128, 256 elements, longer
+#define BATCH_MIN_LENGTH 8          // Array lengths generated by --batch
+#define BATCH_MAX_LENGTH 256
+#define BATCH_DEFAULT_COUNT 1000000
+
+void sortBatch(int values[], const size_t offsets[], size_t count);
+
+// Streaming sort of integers from stdin or a file (--stream)
+#define STREAM_IO_BUFFER (4 << 20)   // Bytes per read() and per output write
+#define STREAM_MIN_CHUNK (1 << 16)   // Elements
+
+typedef struct {
+    const char *input_path;   // NULL or "-" for stdin
+    const char *output_path;  // NULL for stdout
+    int element_size;         // 4 for int32, 8 for int64
+    int binary;               // Native-endian binary instead of decimal text
+    size_t memory_budget;     // Bytes for chunks being parsed, sorted and merged
+} StreamSortConfig;
+
+int streamSort(StreamSortConfig *config);
+void computeBenchStats(double samples[], int count, int n, BenchStats *stats);
+int runBenchmark(BenchConfig *config);
+int runSelectionBenchmark(BenchConfig *config);
+
+// Benchmark scheduler: independent (algorithm, distribution, size,
+// repetition) runs execute concurrently in forked processes, each pinned
+// to its own CPU, and are killed when they outlive the timeout
+typedef enum { JOB_PENDING, JOB_RUNNING, JOB_DONE, JOB_TIMEOUT, JOB_FAILED } JobState;
+
+typedef struct {
+    int algorithm;
+    Distribution dist;
+    int n;
+    int warmup;             // Untimed runs in the job's process before the timed one
+    JobState state;
+    int pin_error;          // errno of a failed sched_setaffinity, or 0
+    int sorted;             // Output was in order
+    SortMeasurement m;      // Timed run
+} BenchJob;
+
+int sched_jobs = 0;           // Concurrent jobs (--jobs); 0 = one per usable CPU
+double sched_timeout = 60;    // Seconds before a job is killed (--timeout); 0 = never
+int sched_one_per_core = 0;   // Leave the other SMT siblings idle (--one-per-core)
+
+int runJobs(BenchJob jobs[], int count);
+
+// Baseline files (--save-baseline, --compare): a version line, the machine
+// fingerprint, then one "cell" line of raw samples per benchmark cell.
+// A cell changed when the Mann-Whitney p-value is below ALPHA and Cliff's
+// delta reaches MIN_EFFECT; --compare fails on slowdowns past --threshold.
+#define BASELINE_VERSION 1
+#define BASELINE_ALPHA 0.01
+#define BASELINE_MIN_EFFECT 0.33   // "Medium" effect size
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS ""             // Build with -DBUILD_FLAGS='"-O2 ..."' to record them
+#endif
+
+FILE *baselineCreate(const char *path, int warmup, int jobs);
+void baselineWriteCell(FILE *file, int algorithm, int dist, int n, const double samples[], int reps);
+double mannWhitneyU(const double x[], int m, const double y[], int n, double *delta);
+int runBaselineCompare(BenchConfig *config);
+
+// Empirical complexity analysis: each algorithm doubles n from MIN_SIZE
+// until its time budget (--budget, or the settings menu) would run out
+#define COMPLEXITY_MIN_SIZE 1024
+#define COMPLEXITY_MAX_SIZE (1 << 27)
+#define COMPLEXITY_MAX_POINTS 24
+#define COMPLEXITY_MIN_SAMPLE 0.02     // Seconds of repeated runs per size
+#define COMPLEXITY_MIN_FIT_TIME 1e-4   // Shorter timings are left out of the fit
+#define COMPLEXITY_SLOPE_CHANGE 0.2    // Smallest exponent change reported
+
+double complexity_budget = 2.0;        // Seconds per algorithm and distribution
+
+typedef struct {
+    int num_points;
+    int sizes[COMPLEXITY_MAX_POINTS];
+    double seconds[COMPLEXITY_MAX_POINTS];
+    int fit_first;                      // First point used by the fit
+    double exponent, ci95, r_squared;   // Fit of log t = a + b log n
+    int break_index;                    // Point where the slope changes, or -1
+    double slope_before, slope_after;
+    const char *stop_reason;
+} ComplexityResult;
+
+void measureComplexity(int algorithm, Distribution dist, double budget, ComplexityResult *r);
+void printComplexityTable(Distribution dist, double budget, const int selected[]);
+int runComplexityAnalysis(BenchConfig *config);
+int runStringBenchmark(const char *path, const char *output_path, BenchConfig *config);
+int runLargeBenchmark(size_t n, BenchConfig *config);
+int runBatchBenchmark(size_t count, BenchConfig *config);
+void printUsage(const char *program);
+
+int main(int argc, char *argv[]) {
+    BenchConfig bench = {0};
+    bench.reps = 15;
+    bench.warmup = 3;
+    bench.format = FORMAT_TABLE;
+    bench.threshold = 5;
+    parseAlgorithmList("all", &bench);
+    parseSizeList("1e3..1e5", &bench);
+    parseDistributionList("uniform", &bench);
+    input_seed = (uint64_t)time(0);
+    ExternalSortConfig external = {NULL, NULL, 4, 256u << 20, 0};
+    StreamSortConfig stream = {NULL, NULL, 4, 0, 0};
+    int streaming = 0;
+    int strings = 0;
+    const char *strings_path = NULL;
+    size_t large_size = 0;
+    size_t batch_count = 0;
+    int algos_given = 0;
+    detectCacheSizes();
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            num_threads = atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench.enabled = 1;
+        } else if (strcmp(argv[i], "--select") == 0) {
+            bench.enabled = 1;
+            bench.selection = 1;
+        } else if (strcmp(argv[i], "--complexity") == 0) {
+            bench.enabled = 1;
+            bench.complexity = 1;
+        } else if (strncmp(argv[i], "--save-baseline=", 16) == 0) {
+            bench.enabled = 1;
+            bench.baseline_path = argv[i] + 16;
+        } else if (strncmp(argv[i], "--compare=", 10) == 0) {
+            bench.enabled = 1;
+            bench.compare_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            bench.threshold = atof(argv[i] + 12);
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            bench.jobs = 1;
+            sched_jobs = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            sched_timeout = atof(argv[i] + 10);
+        } else if (strcmp(argv[i], "--one-per-core") == 0) {
+            sched_one_per_core = 1;
+        } else if (strncmp(argv[i], "--budget=", 9) == 0) {
+            complexity_budget = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--algos=", 8) == 0) {
+            if (!parseAlgorithmList(argv[i] + 8, &bench)) return 1;
+            algos_given = 1;
+        } else if (strncmp(argv[i], "--sizes=", 8) == 0) {
+            if (!parseSizeList(argv[i] + 8, &bench)) return 1;
+        } else if (strncmp(argv[i], "--reps=", 7) == 0) {
+            bench.reps = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+            bench.warmup = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            input_seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            if (!parseCacheSizes(argv[i] + 8)) return 1;
+        } else if (strncmp(argv[i], "--max-scratch=", 14) == 0) {
+            char *end;
+            long long kb = strtoll(argv[i] + 14, &end, 10);
+            if (end == argv[i] + 14 || *end || kb > LLONG_MAX >> 10) {
+                fprintf(stderr, "Invalid scratch limit '%s'\n", argv[i] + 14);
+                return 1;
+            }
+            max_scratch_bytes = kb < 0 ? -1 : kb << 10;
+        } else if (strncmp(argv[i], "--dist=", 7) == 0) {
+            if (!parseDistributionList(argv[i] + 7, &bench)) return 1;
+        } else if (strcmp(argv[i], "--format=csv") == 0) {
+            bench.format = FORMAT_CSV;
+        } else if (strcmp(argv[i], "--format=json") == 0) {
+            bench.format = FORMAT_JSON;
+        } else if (strcmp(argv[i], "--format=table") == 0) {
+            bench.format = FORMAT_TABLE;
+        } else if (strncmp(argv[i], "--external=", 11) == 0) {
+            external.input_path = argv[i] + 11;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            external.output_path = argv[i] + 9;
+        } else if (strcmp(argv[i], "--element=int32") == 0) {
+            external.element_size = 4;
+        } else if (strcmp(argv[i], "--element=int64") == 0) {
+            external.element_size = 8;
+        } else if (strncmp(argv[i], "--memory=", 9) == 0) {
+            external.memory_budget = (size_t)strtoull(argv[i] + 9, NULL, 10) << 20;
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            external.direct_io = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            streaming = 1;
+        } else if (strncmp(argv[i], "--stream=", 9) == 0) {
+            streaming = 1;
+            stream.input_path = argv[i] + 9;
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            stream.binary = 1;
+        } else if (strcmp(argv[i], "--strings") == 0) {
+            strings = 1;
+        } else if (strncmp(argv[i], "--strings=", 10) == 0) {
+            strings = 1;
+            strings_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--large=", 8) == 0) {
+            double size = strtod(argv[i] + 8, NULL);
+            if (size < 2) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            large_size = (size_t)size;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch_count = BATCH_DEFAULT_COUNT;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batch_count = (size_t)strtod(argv[i] + 8, NULL);
+            if (batch_count == 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (num_threads <= 0) {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_threads <= 0) num_threads = 1;
+    }
+    if (bench.reps < 1) bench.reps = 1;
+    if (bench.warmup < 0) bench.warmup = 0;
+
+    int status;
+    if (large_size) {
+        status = runLargeBenchmark(large_size, &bench);
+    } else if (batch_count) {
+        // Looping the quadratic sorts over millions of arrays takes minutes
+        if (!algos_given) parseAlgorithmList("quick,intro,pdq", &bench);
+        status = runBatchBenchmark(batch_count, &bench);
+    } else if (strings) {
+        status = runStringBenchmark(strings_path, external.output_path, &bench);
+    } else if (streaming) {
+        stream.output_path = external.output_path;
+        stream.element_size = external.element_size;
+        stream.memory_budget = external.memory_budget;
+        status = streamSort(&stream);
+    } else if (external.input_path) {
+        if (!external.output_path) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        status = externalSort(&external);
+    } else {
+        if (bench.compare_path) status = runBaselineCompare(&bench);
+        else if (bench.selection) status = runSelectionBenchmark(&bench);
+        else if (bench.complexity) status = runComplexityAnalysis(&bench);
+        else status = bench.enabled ? runBenchmark(&bench) : interactiveMenu();
+    }
+    poolShutdown();
+    return status;
+}
+
+void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [--threads=N] [--max-scratch=KB] [--cache=L1,L2,LLC]\n", program);
+    fprintf(stderr, "       %s --bench [--algos=merge,quick|all] [--sizes=1e3..1e7|1000,5000]\n", program);
+    fprintf(stderr, "           [--dist=uniform,sorted|all] [--reps=15] [--warmup=3] [--seed=N]\n");
+    fprintf(stderr, "           [--format=table|csv|json] [--save-baseline=FILE]\n");
+    fprintf(stderr, "           [--jobs=N|0] [--timeout=SECONDS] [--one-per-core]\n");
+    fprintf(stderr, "       %s --compare=FILE [--threshold=PERCENT]\n", program);
+    fprintf(stderr, "       %s --bench --select [--sizes=...] [--dist=...] [--reps=15] [--format=...]\n", program);
+    fprintf(stderr, "       %s --complexity [--algos=...] [--dist=...] [--budget=SECONDS]\n", program);
+    fprintf(stderr, "       %s --external=IN --output=OUT [--element=int32|int64] [--memory=MB] [--direct]\n",
+            program);
+    fprintf(stderr, "       %s --stream[=IN] [--output=OUT] [--binary] [--element=int32|int64] [--memory=MB]\n",
+            program);
+    fprintf(stderr, "       %s --strings[=IN] [--output=OUT] [--reps=15] [--warmup=3]\n", program);
+    fprintf(stderr, "       %s --large=1e10 [--algos=pdq,radix] [--dist=...] [--seed=N]\n", program);
+    fprintf(stderr, "       %s --batch[=ARRAYS] [--algos=quick,intro,pdq] [--dist=...] [--reps=15]\n", program);
+    fprintf(stderr, "Algorithms:");
+    for (int a = 0; a < num_algorithms; a++) {
+        fprintf(stderr, " %s", algorithms[a].key);
+    }
+    fprintf(stderr, "\nDistributions:");
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        fprintf(stderr, " %s", distribution_keys[d]);
+    }
+    fprintf(stderr, "\n");
+}
+
+int interactiveMenu() {
     int n, choice;
     char input[100];
 
@@ -66,7 +835,18 @@ int main() {
         printf("1. Enable/Disable Visualization (Currently: %s)\n",
                visualize_enabled ? "Enabled" : "Disabled");
         printf("2. Set Visualization Speed (Currently: %d)\n", visualization_speed);
-        printf("3. Return to main menu\n");
+        printf("3. Set Thread Count (Currently: %d)\n", num_threads);
+        printf("4. Set Random Seed (Currently: %llu)\n", (unsigned long long)input_seed);
+        printf("5. Set Frame Rate Cap (Currently: %d fps)\n", visualization_fps);
+        printf("6. Set Complexity Time Budget (Currently: %.1f s per algorithm)\n", complexity_budget);
+        if (max_scratch_bytes < 0) printf("7. Set Max Scratch Memory (Currently: unlimited)\n");
+        else printf("7. Set Max Scratch Memory (Currently: %lld KB)\n", max_scratch_bytes >> 10);
+        if (sched_jobs > 0) printf("8. Set Concurrent Comparison Jobs (Currently: %d)\n", sched_jobs);
+        else printf("8. Set Concurrent Comparison Jobs (Currently: one per CPU)\n");
+        if (sched_timeout > 0) printf("9. Set Job Timeout (Currently: %g s)\n", sched_timeout);
+        else printf("9. Set Job Timeout (Currently: none)\n");
+        printf("10. Toggle One Job per Physical Core (Currently: %s)\n", sched_one_per_core ? "On" : "Off");
+        printf("11. Return to main menu\n");
         printf("Enter choice: ");
         int config_choice;
         scanf("%d", &config_choice);
@@ -78,106 +858,193 @@ int main() {
         } else if (config_choice == 2) {
             printf("Enter visualization speed (1-100000 microseconds): ");
             scanf("%d", &visualization_speed);
+        } else if (config_choice == 3) {
+            printf("Enter number of threads for parallel sorts: ");
+            scanf("%d", &num_threads);
+            if (num_threads < 1) num_threads = 1;
+        } else if (config_choice == 4) {
+            unsigned long long seed;
+            printf("Enter random seed: ");
+            if (scanf("%llu", &seed) == 1) input_seed = seed;
+        } else if (config_choice == 5) {
+            printf("Enter frame rate cap (frames per second, 0 = draw every step): ");
+            scanf("%d", &visualization_fps);
+            if (visualization_fps < 0) visualization_fps = 0;
+        } else if (config_choice == 6) {
+            printf("Enter time budget per algorithm in seconds: ");
+            scanf("%lf", &complexity_budget);
+            if (complexity_budget <= 0) complexity_budget = 0.1;
+        } else if (config_choice == 7) {
+            long long kb;
+            printf("Enter max scratch memory per sort in KB (-1 = unlimited): ");
+            if (scanf("%lld", &kb) == 1) max_scratch_bytes = kb < 0 ? -1 : kb << 10;
+        } else if (config_choice == 8) {
+            printf("Enter concurrent jobs (0 = one per CPU): ");
+            scanf("%d", &sched_jobs);
+            if (sched_jobs < 0) sched_jobs = 0;
+        } else if (config_choice == 9) {
+            printf("Enter job timeout in seconds (0 = no limit): ");
+            scanf("%lf", &sched_timeout);
+            if (sched_timeout < 0) sched_timeout = 0;
+        } else if (config_choice == 10) {
+            sched_one_per_core = !sched_one_per_core;
         }
 
         // Restart program
-        main();
+        interactiveMenu();
         return 0;
     }
 
     printf("\nEnter the number of elements (10-50 for visualization, 1000+ for comparison): ");
     scanf("%d", &n);
 
-    // Create and initialize the original array
+    // Create the original array; each mode fills it from the input seed
     int *original = (int*)malloc(n * sizeof(int));
     int *arr = (int*)malloc(n * sizeof(int));
+    srand((unsigned)input_seed);
 
-    // Generate random numbers
-    srand(time(0));
-    printf("\nGenerating array...\n");
-    for(int i = 0; i < n; i++) {
-        original[i] = rand() % 100 + 1; // Limit to 100 for better visualization
+    // Comparison and analysis modes can sweep every input distribution
+    int first_dist = DIST_UNIFORM, last_dist = DIST_UNIFORM;
+    if (choice == 1 || choice == 3) {
+        printf("\nInput distribution:\n");
+        printf("0. All distributions\n");
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+            printf("%d. %s\n", d + 1, distribution_keys[d]);
+        }
+        printf("Enter choice: ");
+        int dist_choice = 1;
+        scanf("%d", &dist_choice);
+        if (dist_choice == 0) {
+            first_dist = 0;
+            last_dist = NUM_DISTRIBUTIONS - 1;
+        } else if (dist_choice >= 1 && dist_choice <= NUM_DISTRIBUTIONS) {
+            first_dist = last_dist = dist_choice - 1;
+        }
     }
 
-    if (choice == 1) {
+    if (choice == 1 && first_dist != last_dist) {
+        // Distribution sweep: one row per algorithm, one column per distribution
+        printf(CLEAR);
+        printHeader();
+
+        printf("\n" BOLD CYAN "COMPARING ALL SORTING ALGORITHMS ON EVERY DISTRIBUTION\n" RESET);
+        printf("=========================================================\n\n");
+        printf("%d elements, seed %llu, times in seconds:\n", n, (unsigned long long)input_seed);
+
+        // Every (distribution, algorithm) cell is one scheduler job
+        BenchJob jobs[NUM_DISTRIBUTIONS * num_algorithms];
+        int cell_job[NUM_DISTRIBUTIONS][num_algorithms];
+        int job_count = 0;
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+            for (int a = 0; a < num_algorithms; a++) {
+                cell_job[d][a] = isImpracticalRun(a, d, n) ? -1 : job_count;
+                if (cell_job[d][a] < 0) continue;
+                jobs[job_count++] = (BenchJob){.algorithm = a, .dist = d, .n = n, .state = JOB_PENDING};
+            }
+        }
+        runJobs(jobs, job_count);
+        printf("\n");
+
+        printf("+------------+");
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) printf("-----------+");
+        printf("\n| Algorithm  |");
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) printf(" %-9s |", distribution_names[d]);
+        printf("\n+------------+");
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) printf("-----------+");
+        printf("\n");
+        for (int a = 0; a < num_algorithms; a++) {
+            printf("| %-10s |", algorithms[a].name);
+            for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+                BenchJob *job = cell_job[d][a] < 0 ? NULL : &jobs[cell_job[d][a]];
+                if (!job) printf(" %9s |", "skipped");
+                else if (job->state == JOB_TIMEOUT) printf(" %9s |", "timeout");
+                else if (job->state != JOB_DONE || !job->sorted) printf(" %9s |", "failed");
+                else printf(" %9.5f |", job->m.seconds);
+            }
+            printf("\n");
+        }
+        printf("+------------+");
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) printf("-----------+");
+        printf("\n");
+
+    } else if (choice == 1) {
         // Clear screen for comparison mode
         printf(CLEAR);
         printHeader();
 
         // Variables to store execution times
-        clock_t start, end;
-        double selection_time, bubble_time, merge_time, quick_time;
+        double times[num_algorithms];
+        long allocations[num_algorithms];
+        size_t scratch_bytes[num_algorithms], peak_scratch[num_algorithms];
+        const char* names[num_algorithms];
 
         printf("\n" BOLD CYAN "COMPARING ALL SORTING ALGORITHMS\n" RESET);
         printf("==================================\n\n");
 
-        // Prepare array for small visualization
-        int *small_arr = (int*)malloc(20 * sizeof(int));
-        copyArray(original, small_arr, n > 20 ? 20 : n);
+        printf("Generating %s array (seed %llu)...\n", distribution_keys[first_dist],
+               (unsigned long long)input_seed);
+        generateInput(original, n, first_dist, input_seed);
 
-        printf("Sample array (first %d elements):\n", n > 20 ? 20 : n);
-        for(int i = 0; i < (n > 20 ? 20 : n); i++) {
-            printf("[" GREEN "%3d" RESET "] ", small_arr[i]);
+        int sample_size = n > 20 ? 20 : n;
+        printf("Sample array (first %d elements):\n", sample_size);
+        for(int i = 0; i < sample_size; i++) {
+            printf("[" GREEN "%d" RESET "] ", original[i]);
         }
         printf("\n\n");
 
-        // 1. Selection Sort
-        printf(YELLOW "➤ Selection Sort:\n" RESET);
-        printProgressBar(0.1, 50);
-        copyArray(original, arr, n);
-        start = clock();
-        selectionSort(arr, n, 0);
-        end = clock();
-        selection_time = ((double)(end - start)) / CLOCKS_PER_SEC;
-        printf(" Completed in " GREEN "%.6f" RESET " seconds\n", selection_time);
-
-        // 2. Bubble Sort
-        printf(YELLOW "➤ Bubble Sort:\n" RESET);
-        printProgressBar(0.3, 50);
-        copyArray(original, arr, n);
-        start = clock();
-        bubbleSort(arr, n, 0);
-        end = clock();
-        bubble_time = ((double)(end - start)) / CLOCKS_PER_SEC;
-        printf(" Completed in " GREEN "%.6f" RESET " seconds\n", bubble_time);
-
-        // 3. Merge Sort
-        printf(YELLOW "➤ Merge Sort:\n" RESET);
-        printProgressBar(0.6, 50);
-        copyArray(original, arr, n);
-        start = clock();
-        mergeSort(arr, 0, n - 1, 0);
-        end = clock();
-        merge_time = ((double)(end - start)) / CLOCKS_PER_SEC;
-        printf(" Completed in " GREEN "%.6f" RESET " seconds\n", merge_time);
-
-        // 4. Quick Sort
-        printf(YELLOW "➤ Quick Sort:\n" RESET);
-        printProgressBar(0.9, 50);
-        copyArray(original, arr, n);
-        start = clock();
-        quickSort(arr, 0, n - 1, 0);
-        end = clock();
-        quick_time = ((double)(end - start)) / CLOCKS_PER_SEC;
-        printf(" Completed in " GREEN "%.6f" RESET " seconds\n", quick_time);
+        // The algorithms run concurrently, one pinned job each
+        BenchJob jobs[num_algorithms];
+        int job_of[num_algorithms];
+        int job_count = 0;
+        for (int a = 0; a < num_algorithms; a++) {
+            job_of[a] = isImpracticalRun(a, first_dist, n) ? -1 : job_count;
+            if (job_of[a] >= 0) {
+                jobs[job_count++] = (BenchJob){.algorithm = a, .dist = first_dist, .n = n, .state = JOB_PENDING};
+            }
+        }
+        runJobs(jobs, job_count);
+        printf("\n");
+
+        for (int a = 0; a < num_algorithms; a++) {
+            printf(YELLOW "➤ %s Sort:\n" RESET, algorithms[a].name);
+            names[a] = algorithms[a].name;
+            times[a] = 0;
+            allocations[a] = 0;
+            scratch_bytes[a] = peak_scratch[a] = 0;
+            BenchJob *job = job_of[a] < 0 ? NULL : &jobs[job_of[a]];
+            if (!job) {
+                printf(" Skipped: recursion depth grows linearly on this input\n");
+            } else if (job->state == JOB_TIMEOUT) {
+                printf(" Stopped after the %g second job timeout\n", sched_timeout);
+            } else if (job->state != JOB_DONE || !job->sorted) {
+                printf(" " RED "Failed" RESET "\n");
+            } else {
+                times[a] = job->m.seconds;
+                allocations[a] = job->m.allocations;
+                scratch_bytes[a] = job->m.scratch_bytes;
+                peak_scratch[a] = job->m.peak_scratch;
+                printf(" Completed in " GREEN "%.6f" RESET " seconds\n", times[a]);
+            }
+        }
 
         // Display results in a table
         printf("\n" BOLD "RESULTS SUMMARY\n" RESET);
-        printf("+-----------------+-----------------+\n");
-        printf("| Algorithm       | Time (seconds)  |\n");
-        printf("+-----------------+-----------------+\n");
-        printf("| Selection Sort  | %15.6f |\n", selection_time);
-        printf("| Bubble Sort     | %15.6f |\n", bubble_time);
-        printf("| Merge Sort      | %15.6f |\n", merge_time);
-        printf("| Quick Sort      | %15.6f |\n", quick_time);
-        printf("+-----------------+-----------------+\n\n");
+        printf("+-----------------+-----------------+-------------+----------------+---------------+\n");
+        printf("| Algorithm       | Time (seconds)  | Allocations | Scratch (KB)   | Peak (KB)     |\n");
+        printf("+-----------------+-----------------+-------------+----------------+---------------+\n");
+        for (int a = 0; a < num_algorithms; a++) {
+            char label[32];
+            snprintf(label, sizeof(label), "%s Sort", algorithms[a].name);
+            printf("| %-15s | %15.6f | %11ld | %14.1f | %13.1f |\n", label, times[a], allocations[a],
+                   scratch_bytes[a] / 1024.0, peak_scratch[a] / 1024.0);
+        }
+        printf("+-----------------+-----------------+-------------+----------------+---------------+\n");
+        printf("Process peak RSS: %.1f MB", peakRssKB() / 1024.0);
+        if (max_scratch_bytes >= 0) printf(" (scratch limit %lld KB)", max_scratch_bytes >> 10);
+        printf("\n\n");
 
         // Performance comparison with chart
-        double times[] = {selection_time, bubble_time, merge_time, quick_time};
-        const char* names[] = {"Selection", "Bubble", "Merge", "Quick"};
-        printComparisonChart(times, names, 4);
-
-        free(small_arr);
+        printComparisonChart(times, names, num_algorithms);
 
     } else if (choice == 2) {
         // Individual algorithm visualization
@@ -201,16 +1068,15 @@ int main() {
             printf(CLEAR);
             printHeader();
 
-            // Limit n for visualization
-            if (n > 30) n = 30;
-
-            // Regenerate array with smaller values for visualization
+            // Regenerate array with values that scale to the bar width; arrays
+            // larger than the screen are drawn in buckets
+            int value_range = n > VIZ_BAR_WIDTH ? n : VIZ_BAR_WIDTH;
             for(int i = 0; i < n; i++) {
-                original[i] = rand() % 50 + 1;
+                original[i] = rand() % value_range + 1;
             }
 
             printf("\nInitial array (%d elements):\n", n);
-            printArray(original, n);
+            printArray(original, n < 100 ? n : 100);
             printf("\n");
 
             copyArray(original, arr, n);
@@ -219,22 +1085,22 @@ int main() {
                 case 1:
                     printf(BOLD YELLOW "VISUALIZING SELECTION SORT\n" RESET);
                     printf("===========================\n\n");
-                    selectionSort(arr, n, 1);
+                    visualizeAlgorithm(1, arr, n);
                     break;
                 case 2:
                     printf(BOLD GREEN "VISUALIZING BUBBLE SORT\n" RESET);
                     printf("=======================\n\n");
-                    bubbleSort(arr, n, 1);
+                    visualizeAlgorithm(2, arr, n);
                     break;
                 case 3:
                     printf(BOLD BLUE "VISUALIZING MERGE SORT\n" RESET);
                     printf("======================\n\n");
-                    mergeSort(arr, 0, n - 1, 1);
+                    visualizeAlgorithm(3, arr, n);
                     break;
                 case 4:
                     printf(BOLD MAGENTA "VISUALIZING QUICK SORT\n" RESET);
                     printf("======================\n\n");
-                    quickSort(arr, 0, n - 1, 1);
+                    visualizeAlgorithm(4, arr, n);
                     break;
                 case 5:
                     // Show all algorithms in sequence
@@ -244,31 +1110,31 @@ int main() {
                     // Selection Sort
                     printf(YELLOW "\n● SELECTION SORT:\n" RESET);
                     copyArray(original, arr, n);
-                    selectionSort(arr, n, 1);
+                    visualizeAlgorithm(1, arr, n);
                     sleep(1);
 
                     // Bubble Sort
                     printf(GREEN "\n● BUBBLE SORT:\n" RESET);
                     copyArray(original, arr, n);
-                    bubbleSort(arr, n, 1);
+                    visualizeAlgorithm(2, arr, n);
                     sleep(1);
 
                     // Merge Sort
                     printf(BLUE "\n● MERGE SORT:\n" RESET);
                     copyArray(original, arr, n);
-                    mergeSort(arr, 0, n - 1, 1);
+                    visualizeAlgorithm(3, arr, n);
                     sleep(1);
 
                     // Quick Sort
                     printf(MAGENTA "\n● QUICK SORT:\n" RESET);
                     copyArray(original, arr, n);
-                    quickSort(arr, 0, n - 1, 1);
+                    visualizeAlgorithm(4, arr, n);
                     break;
             }
 
             printf("\n\n" BOLD GREEN "✓ Sorting completed!\n" RESET);
             printf("\nSorted array:\n");
-            printArray(arr, n);
+            printArray(arr, n < 100 ? n : 100);
         }
     } else if (choice == 3) {
         // Performance analysis mode
@@ -278,60 +1144,245 @@ int main() {
         printf("\n" BOLD CYAN "PERFORMANCE ANALYSIS MODE\n" RESET);
         printf("============================\n\n");
 
-        int sizes[] = {100, 500, 1000, 5000, 10000};
-        int num_sizes = 5;
+        // Each algorithm grows n on its own until its time budget runs out
+        for (int d = first_dist; d <= last_dist; d++) {
+            printComplexityTable(d, complexity_budget, NULL);
+            printf("\n");
+        }
+
+        // Counters at the user's n, capped so the quadratic sorts finish
+        int largest_size = n < COUNTER_MAX_SIZE ? n : COUNTER_MAX_SIZE;
+        int *counter_arr = (int*)malloc(largest_size * sizeof(int));
+        int *counter_temp = (int*)malloc(largest_size * sizeof(int));
+        generateInput(counter_arr, largest_size, first_dist, input_seed);
+        printf("Counters on %d elements (hardware counters %s, operation counts %s):\n", largest_size,
+               perfAvailable() ? "enabled" : "unavailable",
+#ifdef COUNT_OPERATIONS
+               "enabled");
+#else
+               "off, build with -DCOUNT_OPERATIONS");
+#endif
+        printf("+------------+-----------+--------------+--------------+-------+-------+------------+------------+------------+\n");
+        printf("| Algorithm  | Cmp/nlogn | Swaps        | Moves        | Alloc | IPC   | Br. misses | L1D misses | LLC misses |\n");
+        printf("+------------+-----------+--------------+--------------+-------+-------+------------+------------+------------+\n");
+        for (int a = 0; a < num_algorithms; a++) {
+            SortMeasurement m;
+            measureSort(algorithms[a].sort, counter_arr, counter_temp, largest_size, &m);
+            printf("| %-10s | %9.3f | %12lld | %12lld | %5ld |", algorithms[a].name,
+                   comparisonsPerNLogN(m.ops.comparisons, largest_size), m.ops.swaps, m.ops.moves, m.allocations);
+            if (m.perf.valid[PERF_CYCLES] && m.perf.valid[PERF_INSTRUCTIONS] && m.perf.values[PERF_CYCLES] > 0) {
+                printf(" %5.2f |", (double)m.perf.values[PERF_INSTRUCTIONS] / m.perf.values[PERF_CYCLES]);
+            } else {
+                printf(" %5s |", "n/a");
+            }
+            for (int e = PERF_BRANCH_MISSES; e <= PERF_LLC_MISSES; e++) {
+                if (m.perf.valid[e]) printf(" %10lld |", m.perf.values[e]);
+                else printf(" %10s |", "n/a");
+            }
+            printf("\n");
+        }
+        printf("+------------+-----------+--------------+--------------+-------+-------+------------+------------+------------+\n");
+        free(counter_arr);
+        free(counter_temp);
 
-        printf("Testing with different array sizes:\n");
-        printf("+----------+---------------+---------------+---------------+---------------++\n");
-        printf("| Size     | Selection     | Bubble        | Merge         | Quick         |\n");
-        printf("+----------+---------------+---------------+---------------+---------------++\n");
+        // Branchy Lomuto and three-way partitioning against pdqsort's
+        // branchless block partition, on uniform keys where every
+        // comparison branch is a coin flip
+        void (*partition_sorts[])(int arr[], int n) = {runQuickSort, runIntroSort, runPdqSort};
+        const char *partition_names[] = {"Quick", "Intro", "PDQ"};
+        int *part_arr = (int*)malloc(n * sizeof(int));
+        int *part_temp = (int*)malloc(n * sizeof(int));
+        generateInput(part_arr, n, DIST_UNIFORM, input_seed);
+        printf("\nPartitioning on %d uniform elements (best of 3):\n", n);
+        printf("+------------+--------------+---------+--------------+------------+\n");
+        printf("| Algorithm  | Time (s)     | Speedup | Br. misses   | Misses/n   |\n");
+        printf("+------------+--------------+---------+--------------+------------+\n");
+        double lomuto_time = 0;
+        for (int a = 0; a < 3; a++) {
+            SortMeasurement m, best;
+            for (int r = 0; r < 3; r++) {
+                measureSort(partition_sorts[a], part_arr, part_temp, n, &m);
+                if (r == 0 || m.seconds < best.seconds) best = m;
+            }
+            if (a == 0) lomuto_time = best.seconds;
+            printf("| %-10s | %12.6f | %6.2fx |", partition_names[a], best.seconds, lomuto_time / best.seconds);
+            if (best.perf.valid[PERF_BRANCH_MISSES]) {
+                printf(" %12lld | %10.3f |\n", best.perf.values[PERF_BRANCH_MISSES],
+                       (double)best.perf.values[PERF_BRANCH_MISSES] / n);
+            } else {
+                printf(" %12s | %10s |\n", "n/a", "n/a");
+            }
+        }
+        printf("+------------+--------------+---------+--------------+------------+\n");
+        free(part_arr);
+        free(part_temp);
 
-        for (int i = 0; i < num_sizes; i++) {
-            int test_size = sizes[i];
-            if (test_size > n && i > 0) break;
+        // Merge sort throughput on both sides of every cache level
+        void (*cache_sorts[])(int arr[], int n) = {runMergeSort, runBottomUpMergeSort, runSimdMergeSort,
+                                                   runMultiwayMergeSort};
+        size_t cache_levels[] = {cache_sizes.l1d, cache_sizes.l2, cache_sizes.llc};
+        const char *level_names[] = {"L1", "L2", "LLC", "DRAM"};
+        printf("\nMerge sort throughput across cache levels (L1 %zu KB, L2 %zu KB, LLC %zu KB; Melem/s):\n",
+               cache_sizes.l1d >> 10, cache_sizes.l2 >> 10, cache_sizes.llc >> 10);
+        printf("+-----------+------------+------+------------+------------+------------+------------+\n");
+        printf("| Size      | Array (KB) | Fits | Merge      | BU Merge   | AVX2 Merge | Multiway   |\n");
+        printf("+-----------+------------+------+------------+------------+------------+------------+\n");
+        for (int level = 0; level < 3; level++) {
+            for (int side = 0; side < 2; side++) {
+                int size = (int)(cache_levels[level] / sizeof(int) / 2 * (side ? 4 : 1));
+                int *cache_arr = (int*)malloc((size_t)size * sizeof(int));
+                int *cache_temp = (int*)malloc((size_t)size * sizeof(int));
+                if (!cache_arr || !cache_temp) {
+                    free(cache_arr);
+                    free(cache_temp);
+                    break;
+                }
+                generateInput(cache_arr, size, DIST_UNIFORM, input_seed);
 
-            int *test_arr = (int*)malloc(test_size * sizeof(int));
-            for (int j = 0; j < test_size; j++) {
-                test_arr[j] = rand() % 10000;
+                int fits = 0;
+                while (fits < 3 && (size_t)size * sizeof(int) > cache_levels[fits]) fits++;
+                printf("| %9d | %10zu | %-4s |", size, size * sizeof(int) >> 10, level_names[fits]);
+                for (int s = 0; s < 4; s++) {
+                    double best = 0;
+                    for (int r = 0; r < (size <= (1 << 20) ? 3 : 1); r++) {
+                        double t = timeSort(cache_sorts[s], cache_arr, cache_temp, size);
+                        if (r == 0 || t < best) best = t;
+                    }
+                    printf(" %10.1f |", best > 0 ? size / best / 1e6 : 0);
+                }
+                printf("\n");
+                fflush(stdout);
+                free(cache_arr);
+                free(cache_temp);
             }
+        }
+        printf("+-----------+------------+------+------------+------------+------------+------------+\n");
+
+        // Linear-time sorts against the comparison sorts at large sizes
+        int large_sizes[] = {1000000, 10000000, 100000000};
+        int num_large_sizes = 3;
 
-            clock_t start, end;
-            double times[4];
+        if (n >= large_sizes[0]) {
+            printf("\nLinear-time sorts on large arrays:\n");
+            printf("+-----------+--------+---------------+---------------+---------------+---------------+---------------+---------------+\n");
+            printf("| Size      | Keys   | Merge         | Quick         | Intro         | Counting      | Radix 8-bit   | Radix 11-bit  |\n");
+            printf("+-----------+--------+---------------+---------------+---------------+---------------+---------------+---------------+\n");
+        }
+        int *test_arr, *temp;
+        for (int i = 0; i < num_large_sizes && large_sizes[i] <= n; i++) {
+            int test_size = large_sizes[i];
+            test_arr = (int*)malloc(test_size * sizeof(int));
+            temp = (int*)malloc(test_size * sizeof(int));
 
-            // Time each algorithm
-            int *temp = (int*)malloc(test_size * sizeof(int));
+            for (int keys = 0; keys < 2; keys++) {
+                generateInput(test_arr, test_size, DIST_UNIFORM, input_seed);
+                if (keys == 0) {
+                    for (int j = 0; j < test_size; j++) test_arr[j] = (int)((unsigned)test_arr[j] % 10000);
+                }
+                printf("| %9d | %-6s | %13.6f |", test_size, keys == 0 ? "0-9999" : "32-bit",
+                       timeSort(runMergeSort, test_arr, temp, test_size));
+                // Lomuto partitioning is quadratic on runs of equal keys
+                if (keys == 0 && test_size > large_sizes[0]) printf(" %13s |", "skipped");
+                else printf(" %13.6f |", timeSort(runQuickSort, test_arr, temp, test_size));
+                printf(" %13.6f | %13.6f | %13.6f | %13.6f |\n",
+                       timeSort(runIntroSort, test_arr, temp, test_size),
+                       timeSort(runCountingSort, test_arr, temp, test_size),
+                       timeSort(runRadixSort, test_arr, temp, test_size),
+                       timeSort(runRadixSort11, test_arr, temp, test_size));
+            }
 
-            copyArray(test_arr, temp, test_size);
-            start = clock();
-            selectionSort(temp, test_size, 0);
-            end = clock();
-            times[0] = ((double)(end - start)) / CLOCKS_PER_SEC;
+            free(test_arr);
+            free(temp);
+        }
+        if (n >= large_sizes[0]) {
+            printf("+-----------+--------+---------------+---------------+---------------+---------------+---------------+---------------+\n");
+        }
 
-            copyArray(test_arr, temp, test_size);
-            start = clock();
-            bubbleSort(temp, test_size, 0);
-            end = clock();
-            times[1] = ((double)(end - start)) / CLOCKS_PER_SEC;
+        // Vectorized base case against the scalar one
+        printf("\nAVX2 kernels (%s):\n", simdAvailable() ? "enabled" : "unavailable, scalar fallback");
+        printf("+-----------+---------------+---------------+---------+\n");
+        printf("| Block     | Insertion     | Network       | Speedup |\n");
+        printf("+-----------+---------------+---------------+---------+\n");
+        int kernel_total = 1 << 20;
+        test_arr = (int*)malloc(kernel_total * sizeof(int));
+        temp = (int*)malloc(kernel_total * sizeof(int));
+        generateInput(test_arr, kernel_total, DIST_UNIFORM, input_seed);
+        for (int block = 8; block <= SIMD_BLOCK_SIZE; block *= 2) {
+            double start, scalar_time, network_time;
 
-            copyArray(test_arr, temp, test_size);
-            start = clock();
-            mergeSort(temp, 0, test_size - 1, 0);
-            end = clock();
-            times[2] = ((double)(end - start)) / CLOCKS_PER_SEC;
+            copyArray(test_arr, temp, kernel_total);
+            start = nowSeconds();
+            for (int j = 0; j < kernel_total; j += block) insertionSortRange(temp, j, j + block - 1);
+            scalar_time = nowSeconds() - start;
 
-            copyArray(test_arr, temp, test_size);
-            start = clock();
-            quickSort(temp, 0, test_size - 1, 0);
-            end = clock();
-            times[3] = ((double)(end - start)) / CLOCKS_PER_SEC;
+            copyArray(test_arr, temp, kernel_total);
+            start = nowSeconds();
+            for (int j = 0; j < kernel_total; j += block) simdSortSmall(temp + j, block);
+            network_time = nowSeconds() - start;
 
-            printf("| %8d | %13.6f | %13.6f | %13.6f | %13.6f |\n",
-                   test_size, times[0], times[1], times[2], times[3]);
+            printf("| %9d | %13.6f | %13.6f | %6.2fx |\n", block, scalar_time, network_time,
+                   scalar_time / network_time);
+        }
+        printf("+-----------+---------------+---------------+---------+\n");
+        free(test_arr);
+        free(temp);
 
+        printf("\nAVX2 hybrid merge sort against the scalar bottom-up merge sort:\n");
+        printf("+-----------+---------------+---------------+---------+\n");
+        printf("| Size      | BU Merge      | AVX2 Merge    | Speedup |\n");
+        printf("+-----------+---------------+---------------+---------+\n");
+        for (int test_size = 1000; test_size <= n; test_size *= 10) {
+            test_arr = (int*)malloc(test_size * sizeof(int));
+            temp = (int*)malloc(test_size * sizeof(int));
+            generateInput(test_arr, test_size, DIST_UNIFORM, input_seed);
+            double scalar_time = timeSort(runBottomUpMergeSort, test_arr, temp, test_size);
+            double simd_time = timeSort(runSimdMergeSort, test_arr, temp, test_size);
+            printf("| %9d | %13.6f | %13.6f | %6.2fx |\n", test_size, scalar_time, simd_time,
+                   scalar_time / simd_time);
             free(test_arr);
             free(temp);
         }
-        printf("+----------+---------------+---------------+---------------+---------------++\n");
+        printf("+-----------+---------------+---------------+---------+\n");
+
+        // Type-specialized sorts against qsort() with a comparison callback
+        printf("\nType-specialized sorts against qsort() on %d elements:\n", n);
+        printf("+-------------+---------------+---------------+---------------+---------+\n");
+        printf("| Type        | qsort         | Introsort     | Stable merge  | Speedup |\n");
+        printf("+-------------+---------------+---------------+---------------+---------+\n");
+        for (int type = 0; type < NUM_TYPED_BENCHMARKS; type++) {
+            double qsort_time, intro_time, stable_time;
+            timeTypedSorts(type, n, &qsort_time, &intro_time, &stable_time);
+            printf("| %-11s | %13.6f | %13.6f | %13.6f | %6.2fx |\n", typed_benchmark_names[type],
+                   qsort_time, intro_time, stable_time, qsort_time / intro_time);
+        }
+        printf("+-------------+---------------+---------------+---------------+---------+\n");
+
+        // Parallel scaling against the single-threaded merge and quick sorts
+        test_arr = (int*)malloc(n * sizeof(int));
+        temp = (int*)malloc(n * sizeof(int));
+        generateInput(test_arr, n, DIST_UNIFORM, input_seed);
+        double merge_base = timeSort(runMergeSort, test_arr, temp, n);
+        double quick_base = timeSort(runQuickSort, test_arr, temp, n);
+        int saved_threads = num_threads;
+
+        printf("\nParallel scaling on %d elements (Merge %.6fs, Quick %.6fs single-threaded):\n",
+               n, merge_base, quick_base);
+        printf("+---------+---------------+---------+--------+---------------+---------+--------+\n");
+        printf("| Threads | Par Merge     | Speedup | Eff.   | Par Quick     | Speedup | Eff.   |\n");
+        printf("+---------+---------------+---------+--------+---------------+---------+--------+\n");
+        for (int t = 1; t <= saved_threads; t = (t * 2 > saved_threads && t < saved_threads) ? saved_threads : t * 2) {
+            num_threads = t;
+            double merge_time = timeSort(runParallelMergeSort, test_arr, temp, n);
+            double quick_time = timeSort(runParallelQuickSort, test_arr, temp, n);
+            printf("| %7d | %13.6f | %6.2fx | %5.1f%% | %13.6f | %6.2fx | %5.1f%% |\n",
+                   t, merge_time, merge_base / merge_time, 100.0 * merge_base / merge_time / t,
+                   quick_time, quick_base / quick_time, 100.0 * quick_base / quick_time / t);
+        }
+        printf("+---------+---------------+---------+--------+---------------+---------+--------+\n");
+        num_threads = saved_threads;
+
+        free(test_arr);
+        free(temp);
     }
 
     printf("\n\n" BOLD "Press Enter to continue..." RESET);
@@ -343,274 +1394,6275 @@ int main() {
     free(arr);
 
     // Restart
-    main();
+    interactiveMenu();
     return 0;
 }
 
-// Print header with ASCII art
-void printHeader() {
-    printf(CYAN BOLD);
-    printf("╔══════════════════════════════════════════════════════╗\n");
-    printf("║                                                      ║\n");
-    printf("║      SORTING ALGORITHM VISUALIZER                    ║\n");
-    printf("║      ===========================                    ║\n");
-    printf("║                                                      ║\n");
-    printf("╚══════════════════════════════════════════════════════╝\n");
-    printf(RESET);
-}
+// Select algorithms from a comma-separated list of keys, or "all"
+int parseAlgorithmList(const char *list, BenchConfig *config) {
+    char buffer[256];
+    strncpy(buffer, list, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
 
-// Print progress bar
-void printProgressBar(float progress, int width) {
-    printf("[");
-    int pos = width * progress;
-    for (int i = 0; i < width; i++) {
-        if (i < pos) printf("=");
-        else if (i == pos) printf(">");
-        else printf(" ");
+    memset(config->selected, 0, sizeof(config->selected));
+    for (char *token = strtok(buffer, ","); token; token = strtok(NULL, ",")) {
+        int found = 0;
+        for (int a = 0; a < num_algorithms; a++) {
+            if (strcmp(token, "all") == 0 || strcmp(token, algorithms[a].key) == 0) {
+                config->selected[a] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown algorithm: %s\n", token);
+            return 0;
+        }
     }
-    printf("] %d%%\r", (int)(progress * 100.0));
-    fflush(stdout);
+    return 1;
 }
 
-// Print comparison chart
-void printComparisonChart(double times[], const char* names[], int num_sorts) {
-    printf(BOLD "\nPERFORMANCE COMPARISON CHART:\n" RESET);
-    printf("(Bar length represents relative speed)\n\n");
-
-    // Find maximum time for scaling
-    double max_time = 0;
-    for (int i = 0; i < num_sorts; i++) {
-        if (times[i] > max_time) max_time = times[i];
-    }
-
-    // Print bars
-    for (int i = 0; i < num_sorts; i++) {
-        printf("%-12s: ", names[i]);
-
-        // Choose color based on algorithm
-        if (strcmp(names[i], "Selection") == 0) printf(YELLOW);
-        else if (strcmp(names[i], "Bubble") == 0) printf(GREEN);
-        else if (strcmp(names[i], "Merge") == 0) printf(BLUE);
-        else if (strcmp(names[i], "Quick") == 0) printf(MAGENTA);
+// Parse sizes such as "1000,5000" or "1e3..1e7" (every power of ten in range)
+int parseSizeList(const char *list, BenchConfig *config) {
+    char buffer[256];
+    strncpy(buffer, list, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
 
-        int bar_length = 50 - (int)((times[i] / max_time) * 50);
-        if (bar_length < 1) bar_length = 1;
+    config->num_sizes = 0;
+    for (char *token = strtok(buffer, ","); token; token = strtok(NULL, ",")) {
+        char *range = strstr(token, "..");
+        double low = strtod(token, NULL);
+        double high = range ? strtod(range + 2, NULL) : low;
 
-        for (int j = 0; j < bar_length; j++) {
-            printf("█");
+        if (low < 1 || high < low || high > INT_MAX) {
+            fprintf(stderr, "Invalid size: %s\n", token);
+            return 0;
+        }
+        for (double size = low; size <= high && config->num_sizes < BENCH_MAX_SIZES; size *= 10) {
+            config->sizes[config->num_sizes++] = (int)size;
         }
-        printf(" %12.6f seconds\n" RESET, times[i]);
     }
+    return config->num_sizes > 0;
+}
 
-    // Determine fastest and slowest
-    double fastest = times[0];
-    double slowest = times[0];
-    int fastest_idx = 0, slowest_idx = 0;
+// Select input distributions from a comma-separated list of keys, or "all"
+int parseDistributionList(const char *list, BenchConfig *config) {
+    char buffer[256];
+    strncpy(buffer, list, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
 
-    for (int i = 1; i < num_sorts; i++) {
-        if (times[i] < fastest) {
-            fastest = times[i];
-            fastest_idx = i;
+    memset(config->distributions, 0, sizeof(config->distributions));
+    for (char *token = strtok(buffer, ","); token; token = strtok(NULL, ",")) {
+        if (strcmp(token, "all") == 0) {
+            for (int d = 0; d < NUM_DISTRIBUTIONS; d++) config->distributions[d] = 1;
+            continue;
         }
-        if (times[i] > slowest) {
-            slowest = times[i];
-            slowest_idx = i;
+        int d = distributionFromKey(token);
+        if (d < 0) {
+            fprintf(stderr, "Unknown distribution: %s\n", token);
+            return 0;
         }
+        config->distributions[d] = 1;
     }
+    return 1;
+}
 
-    printf("\n" BOLD "Analysis:\n" RESET);
-    printf("• Fastest: %s Sort (%.6f seconds)\n", names[fastest_idx], fastest);
-    printf("• Slowest: %s Sort (%.6f seconds)\n", names[slowest_idx], slowest);
-    printf("• Speed ratio (Slowest/Fastest): %.2fx\n", slowest/fastest);
+// Min/median/p95 (nearest rank), mean and sample standard deviation
+void computeBenchStats(double samples[], int count, int n, BenchStats *stats) {
+    for (int i = 1; i < count; i++) {
+        double key = samples[i];
+        int j = i - 1;
+        while (j >= 0 && samples[j] > key) {
+            samples[j + 1] = samples[j];
+            j--;
+        }
+        samples[j + 1] = key;
+    }
+
+    double sum = 0, squares = 0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    stats->mean = sum / count;
+    for (int i = 0; i < count; i++) {
+        squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+    }
+    stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+    stats->min = samples[0];
+    stats->median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    int rank = (int)ceil(0.95 * count) - 1;
+    stats->p95 = samples[rank < 0 ? 0 : rank];
+    stats->elements_per_second = stats->median > 0 ? n / stats->median : 0;
 }
 
-// Visualization function
-void visualizeSort(int arr[], int n, int index1, int index2, const char* sortName, int color) {
-    if (!visualize_enabled) return;
+// Time every selected algorithm at every size. Each repetition sorts a
+// fresh copy of the same input; warmup runs are discarded. With --jobs
+// every repetition is a scheduler job whose process runs the warmup sorts
+// before its timed one, and a cell with a timed-out repetition is
+// skipped. Returns a nonzero exit status if any algorithm produced
+// unsorted output.
+int runBenchmark(BenchConfig *config) {
+    double *samples = (double*)malloc(config->reps * sizeof(double));
+    int first = 1, status = 0;
+    FILE *baseline = NULL;
+    BenchJob *jobs = NULL;
+    int next_job = 0;
 
-    printf(CLEAR);
-    printHeader();
+    if (config->baseline_path && !(baseline = baselineCreate(config->baseline_path, config->warmup,
+                                                                  config->jobs ? sched_jobs : -1))) {
+        free(samples);
+        return 1;
+    }
 
-    printf("\n" BOLD);
-    switch(color) {
-        case 1: printf(YELLOW); break;
-        case 2: printf(GREEN); break;
-        case 3: printf(BLUE); break;
-        case 4: printf(MAGENTA); break;
+    if (config->jobs) {
+        int count = 0;
+        jobs = (BenchJob*)malloc((size_t)num_algorithms * NUM_DISTRIBUTIONS * config->num_sizes * config->reps *
+                                 sizeof(BenchJob));
+        for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+            if (!config->distributions[d]) continue;
+            for (int s = 0; s < config->num_sizes; s++) {
+                for (int a = 0; a < num_algorithms; a++) {
+                    if (!config->selected[a] || isImpracticalRun(a, d, config->sizes[s])) continue;
+                    for (int r = 0; r < config->reps; r++) {
+                        jobs[count++] = (BenchJob){.algorithm = a, .dist = d, .n = config->sizes[s],
+                                                   .warmup = config->warmup, .state = JOB_PENDING};
+                    }
+                }
+            }
+        }
+        runJobs(jobs, count);
     }
-    printf("%s IN PROGRESS\n" RESET, sortName);
-    printf("====================================\n\n");
 
-    // Calculate maximum value for scaling
-    int max_val = arr[0];
-    for(int i = 1; i < n; i++) {
-        if(arr[i] > max_val) max_val = arr[i];
+    if (config->format == FORMAT_CSV) {
+        printf("algorithm,distribution,size,reps,min_s,median_s,p95_s,mean_s,stddev_s,elements_per_s");
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) printf(",%s", perf_event_names[e]);
+        printf(",ipc,comparisons,comparisons_per_nlogn,swaps,moves,allocations,scratch_bytes,peak_scratch_bytes\n");
+    } else if (config->format == FORMAT_JSON) {
+        printf("{\"threads\": %d, \"seed\": %llu, \"warmup\": %d, \"results\": [\n",
+               num_threads, (unsigned long long)input_seed, config->warmup);
+    } else {
+        printf("+------------+-----------+-----------+--------------+--------------+--------------+--------------+--------------+\n");
+        printf("| Algorithm  | Input     | Size      | Min (s)      | Median (s)   | P95 (s)      | Stddev (s)   | Elements/s   |\n");
+        printf("+------------+-----------+-----------+--------------+--------------+--------------+--------------+--------------+\n");
     }
 
-    // Print array as bars
-    for(int i = 0; i < n; i++) {
-        int bar_length = (arr[i] * 50) / max_val;
-        if (bar_length < 1) bar_length = 1;
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (!config->distributions[d]) continue;
 
-        // Highlight the elements being compared/swapped
-        if (i == index1 || i == index2) {
-            printf(RED BOLD);
-        } else {
-            switch(color) {
-                case 1: printf(YELLOW); break;
-                case 2: printf(GREEN); break;
-                case 3: printf(BLUE); break;
-                case 4: printf(MAGENTA); break;
+        for (int s = 0; s < config->num_sizes; s++) {
+            int n = config->sizes[s];
+            int *input = jobs ? NULL : (int*)malloc(n * sizeof(int));
+            int *work = jobs ? NULL : (int*)malloc(n * sizeof(int));
+
+            if (!jobs) generateInput(input, n, d, input_seed);
+
+            for (int a = 0; a < num_algorithms; a++) {
+                if (!config->selected[a]) continue;
+                if (isImpracticalRun(a, d, n)) {
+                    fprintf(stderr, "Skipping %s on %s input at n=%d\n", algorithms[a].key, distribution_keys[d], n);
+                    continue;
+                }
+
+                // Hardware counters are averaged over the timed repetitions
+                SortMeasurement m;
+                PerfSample perf = {{0}, {0}};
+                int unsorted = 0, timed_out = 0;
+                for (int r = 0; r < config->warmup + config->reps; r++) {
+                    if (jobs) {
+                        if (r < config->warmup) continue;
+                        BenchJob *job = &jobs[next_job++];
+                        m = job->m;
+                        timed_out |= job->state != JOB_DONE;
+                        unsorted |= job->state == JOB_DONE && !job->sorted;
+                    } else {
+                        measureSort(algorithms[a].sort, input, work, n, &m);
+                        if (r < config->warmup) continue;
+                    }
+                    samples[r - config->warmup] = m.seconds;
+                    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+                        perf.values[e] += m.perf.values[e] / config->reps;
+                        perf.valid[e] = m.perf.valid[e];
+                    }
+                }
+                if (timed_out) {
+                    fprintf(stderr, "Skipping %s on %s input at n=%d: a job timed out or failed\n",
+                            algorithms[a].key, distribution_keys[d], n);
+                    continue;
+                }
+                if (baseline) baselineWriteCell(baseline, a, d, n, samples, config->reps);
+                double ipc = perf.valid[PERF_CYCLES] && perf.valid[PERF_INSTRUCTIONS] && perf.values[PERF_CYCLES] > 0
+                    ? (double)perf.values[PERF_INSTRUCTIONS] / perf.values[PERF_CYCLES] : -1;
+                for (int i = 1; i < n && !jobs && !unsorted; i++) {
+                    unsorted = work[i - 1] > work[i];
+                }
+                if (unsorted) {
+                    fprintf(stderr, "%s produced unsorted output on %s input at n=%d\n",
+                            algorithms[a].key, distribution_keys[d], n);
+                    status = 2;
+                }
+
+                BenchStats stats;
+                computeBenchStats(samples, config->reps, n, &stats);
+                if (config->format == FORMAT_CSV) {
+                    printf("%s,%s,%d,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.1f", algorithms[a].key, distribution_keys[d],
+                           n, config->reps,
+                           stats.min, stats.median, stats.p95, stats.mean, stats.stddev,
+                           stats.elements_per_second);
+                    // Missing counters are left empty
+                    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+                        if (perf.valid[e]) printf(",%lld", perf.values[e]);
+                        else printf(",");
+                    }
+                    if (ipc >= 0) printf(",%.3f", ipc);
+                    else printf(",");
+                    printf(",%lld,%.4f,%lld,%lld,%ld,%zu,%zu\n", m.ops.comparisons,
+                           comparisonsPerNLogN(m.ops.comparisons, n), m.ops.swaps, m.ops.moves, m.allocations,
+                           m.scratch_bytes, m.peak_scratch);
+                } else if (config->format == FORMAT_JSON) {
+                    printf("%s  {\"algorithm\": \"%s\", \"distribution\": \"%s\", \"size\": %d, \"reps\": %d, "
+                           "\"min_s\": %.9f, \"median_s\": %.9f, \"p95_s\": %.9f, \"mean_s\": %.9f, "
+                           "\"stddev_s\": %.9f, \"elements_per_s\": %.1f", first ? "" : ",\n",
+                           algorithms[a].key, distribution_keys[d], n, config->reps,
+                           stats.min, stats.median, stats.p95, stats.mean, stats.stddev,
+                           stats.elements_per_second);
+                    // Missing counters are null
+                    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+                        if (perf.valid[e]) printf(", \"%s\": %lld", perf_event_names[e], perf.values[e]);
+                        else printf(", \"%s\": null", perf_event_names[e]);
+                    }
+                    if (ipc >= 0) printf(", \"ipc\": %.3f", ipc);
+                    else printf(", \"ipc\": null");
+                    printf(", \"comparisons\": %lld, \"comparisons_per_nlogn\": %.4f, \"swaps\": %lld, "
+                           "\"moves\": %lld, \"allocations\": %ld, \"scratch_bytes\": %zu, "
+                           "\"peak_scratch_bytes\": %zu}", m.ops.comparisons,
+                           comparisonsPerNLogN(m.ops.comparisons, n), m.ops.swaps, m.ops.moves, m.allocations,
+                           m.scratch_bytes, m.peak_scratch);
+                } else {
+                    printf("| %-10s | %-9s | %9d | %12.6f | %12.6f | %12.6f | %12.6f | %12.4g |\n",
+                           algorithms[a].name, distribution_keys[d], n,
+                           stats.min, stats.median, stats.p95, stats.stddev, stats.elements_per_second);
+                }
+                first = 0;
+                fflush(stdout);
             }
-        }
 
-        // Print the bar
-        for(int j = 0; j < bar_length; j++) {
-            printf("█");
+            free(input);
+            free(work);
         }
-        printf(" %3d\n" RESET, arr[i]);
     }
 
-    usleep(visualization_speed); // Delay for visualization
+    if (config->format == FORMAT_JSON) {
+        printf("\n], \"peak_rss_kb\": %ld}\n", peakRssKB());
+    } else if (config->format == FORMAT_TABLE) {
+        printf("+------------+-----------+-----------+--------------+--------------+--------------+--------------+--------------+\n");
+        printf("Process peak RSS: %.1f MB\n", peakRssKB() / 1024.0);
+    }
+    if (baseline) fclose(baseline);
+    free(jobs);
+    free(samples);
+    return status;
 }
 
-// Modified sorting functions with visualization
-void selectionSort(int arr[], int n, int visualize) {
-    int i, j, min_idx, temp;
+// Baseline store and regression detection
 
-    for(i = 0; i < n - 1; i++) {
-        min_idx = i;
-        for(j = i + 1; j < n; j++) {
-            if(visualize) visualizeSort(arr, n, j, min_idx, "SELECTION SORT", 1);
-            if(arr[j] < arr[min_idx]) {
-                min_idx = j;
-            }
+// Machine and build description stored with a baseline
+static void machineFingerprint(char cpu[], char governor[], char compiler[], size_t size) {
+    char line[512];
+    FILE *file;
+
+    snprintf(cpu, size, "unknown");
+    if ((file = fopen("/proc/cpuinfo", "r"))) {
+        while (fgets(line, sizeof(line), file)) {
+            char *value = strchr(line, ':');
+            if (strncmp(line, "model name", 10) != 0 || !value) continue;
+            value += 1 + strspn(value + 1, " \t");
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(cpu, size, "%.*s", (int)size - 1, value);
+            break;
         }
-        // Swap
-        temp = arr[min_idx];
-        arr[min_idx] = arr[i];
-        arr[i] = temp;
-        if(visualize) visualizeSort(arr, n, i, min_idx, "SELECTION SORT", 1);
+        fclose(file);
     }
-    if(visualize) visualizeSort(arr, n, -1, -1, "SELECTION SORT - COMPLETED", 1);
-}
 
-void bubbleSort(int arr[], int n, int visualize) {
-    int i, j, temp;
-    for(i = 0; i < n - 1; i++) {
-        for(j = 0; j < n - i - 1; j++) {
-            if(visualize) visualizeSort(arr, n, j, j+1, "BUBBLE SORT", 2);
-            if(arr[j] > arr[j + 1]) {
-                temp = arr[j];
-                arr[j] = arr[j + 1];
-                arr[j + 1] = temp;
-                if(visualize) visualizeSort(arr, n, j, j+1, "BUBBLE SORT", 2);
-            }
+    snprintf(governor, size, "unknown");
+    if ((file = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", "r"))) {
+        if (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(governor, size, "%.*s", (int)size - 1, line);
         }
+        fclose(file);
     }
-    if(visualize) visualizeSort(arr, n, -1, -1, "BUBBLE SORT - COMPLETED", 2);
+
+    snprintf(compiler, size, "%s%s%s%s%s", __VERSION__, BUILD_FLAGS,
+#ifdef HAVE_AVX2_KERNELS
+             " avx2-kernels",
+#else
+             "",
+#endif
+#ifdef COUNT_OPERATIONS
+             " -DCOUNT_OPERATIONS",
+#else
+             "",
+#endif
+#ifdef NO_TRACE
+             " -DNO_TRACE"
+#else
+             ""
+#endif
+             );
 }
 
-void merge(int arr[], int left, int mid, int right, int visualize) {
-    int i, j, k;
-    int n1 = mid - left + 1;
-    int n2 = right - mid;
+// Start a baseline file: format version, fingerprint and run settings.
+// jobs is the --jobs concurrency the samples were taken with, or -1 if
+// they were measured in-process.
+FILE *baselineCreate(const char *path, int warmup, int jobs) {
+    char cpu[256], governor[256], compiler[256];
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+    machineFingerprint(cpu, governor, compiler, sizeof(cpu));
+    fprintf(file, "sorting-methods-baseline %d\n", BASELINE_VERSION);
+    fprintf(file, "cpu %s\ngovernor %s\ncompiler %s\n", cpu, governor, compiler);
+    fprintf(file, "threads %d\nseed %llu\nwarmup %d\njobs %d\n", num_threads, (unsigned long long)input_seed, warmup,
+            jobs);
+    return file;
+}
 
-    int *L = (int*)malloc(n1 * sizeof(int));
-    int *R = (int*)malloc(n2 * sizeof(int));
+void baselineWriteCell(FILE *file, int algorithm, int dist, int n, const double samples[], int reps) {
+    fprintf(file, "cell %s %s %d %d", algorithms[algorithm].key, distribution_keys[dist], n, reps);
+    for (int r = 0; r < reps; r++) fprintf(file, " %.9e", samples[r]);
+    fprintf(file, "\n");
+}
 
-    for(i = 0; i < n1; i++)
-        L[i] = arr[left + i];
-    for(j = 0; j < n2; j++)
-        R[j] = arr[mid + 1 + j];
+// Mann-Whitney U test of x against y with the normal approximation,
+// corrected for ties and continuity. Returns the two-sided p-value and sets
+// *delta to Cliff's delta, P(y > x) - P(y < x), in [-1, 1].
+double mannWhitneyU(const double x[], int m, const double y[], int n, double *delta) {
+    int total = m + n;
+    double *values = (double*)malloc(total * sizeof(double));
+    int *from_y = (int*)malloc(total * sizeof(int));
+    for (int i = 0; i < total; i++) {
+        values[i] = i < m ? x[i] : y[i - m];
+        from_y[i] = i >= m;
+    }
+    // Insertion sort; samples are small
+    for (int i = 1; i < total; i++) {
+        double v = values[i];
+        int f = from_y[i], j = i - 1;
+        while (j >= 0 && values[j] > v) {
+            values[j + 1] = values[j];
+            from_y[j + 1] = from_y[j];
+            j--;
+        }
+        values[j + 1] = v;
+        from_y[j + 1] = f;
+    }
 
-    i = 0;
-    j = 0;
-    k = left;
+    // Midranks for ties; the tie term corrects the variance
+    double rank_sum_y = 0, tie_term = 0;
+    for (int i = 0; i < total;) {
+        int j = i;
+        while (j + 1 < total && values[j + 1] == values[i]) j++;
+        double rank = (i + j) / 2.0 + 1;
+        int ties = j - i + 1;
+        for (int k = i; k <= j; k++) {
+            if (from_y[k]) rank_sum_y += rank;
+        }
+        tie_term += (double)ties * ties * ties - ties;
+        i = j + 1;
+    }
+    free(values);
+    free(from_y);
 
-    while(i < n1 && j < n2) {
-        if(visualize) visualizeSort(arr, right+1, left+i, mid+1+j, "MERGE SORT", 3);
-        if(L[i] <= R[j]) {
-            arr[k] = L[i];
-            i++;
+    double u_y = rank_sum_y - n * (n + 1) / 2.0;
+    double mean = m * (double)n / 2;
+    double variance = m * (double)n / 12 * ((total + 1) - tie_term / ((double)total * (total - 1)));
+    *delta = 2 * u_y / ((double)m * n) - 1;
+    if (variance <= 0) return 1;
+    double z = (fabs(u_y - mean) - 0.5) / sqrt(variance);
+    if (z < 0) z = 0;
+    return erfc(z / sqrt(2));
+}
+
+static double sampleMedian(const double samples[], int count) {
+    double *sorted = (double*)malloc(count * sizeof(double));
+    BenchStats stats;
+    memcpy(sorted, samples, count * sizeof(double));
+    computeBenchStats(sorted, count, 1, &stats);
+    free(sorted);
+    return stats.median;
+}
+
+// Rerun every cell of a baseline file (--compare) with the baseline's seed,
+// thread count and repetitions, as scheduler jobs if the baseline was taken
+// with --jobs, and print the cells whose timings changed significantly.
+// Returns 3 if any significant regression exceeds config->threshold percent.
+int runBaselineCompare(BenchConfig *config) {
+    FILE *file = fopen(config->compare_path, "r");
+    if (!file) {
+        perror(config->compare_path);
+        return 1;
+    }
+
+    char line[1 << 16], cpu[256], governor[256], compiler[256];
+    int version = 0, warmup = config->warmup, jobs = -1;
+    if (!fgets(line, sizeof(line), file) || sscanf(line, "sorting-methods-baseline %d", &version) != 1 ||
+        version != BASELINE_VERSION) {
+        fprintf(stderr, "%s is not a version %d baseline file\n", config->compare_path, BASELINE_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    machineFingerprint(cpu, governor, compiler, sizeof(cpu));
+    const char *fields[] = {"cpu ", "governor ", "compiler "};
+    const char *current[] = {cpu, governor, compiler};
+    int regressions = 0, failing = 0, improvements = 0, cells = 0, status = 0;
+    double *baseline = NULL, *samples = NULL;
+
+    printf("+------------+-----------+-----------+--------------+--------------+----------+--------+----------+-------------+\n");
+    printf("| Algorithm  | Input     | Size      | Base median  | New median   | Change   | Delta  | p        | Verdict     |\n");
+    printf("+------------+-----------+-----------+--------------+--------------+----------+--------+----------+-------------+\n");
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        for (int f = 0; f < 3; f++) {
+            size_t length = strlen(fields[f]);
+            if (strncmp(line, fields[f], length) == 0 && strcmp(line + length, current[f]) != 0) {
+                fprintf(stderr, "Warning: baseline %s'%s' differs from this run's '%s'\n", fields[f],
+                        line + length, current[f]);
+            }
+        }
+        unsigned long long seed;
+        int threads;
+        if (sscanf(line, "seed %llu", &seed) == 1) input_seed = seed;
+        if (sscanf(line, "threads %d", &threads) == 1 && threads > 0) {
+            if (threads != num_threads) {
+                fprintf(stderr, "Using the baseline's %d threads instead of %d\n", threads, num_threads);
+            }
+            num_threads = threads;
+        }
+        sscanf(line, "warmup %d", &warmup);
+        if (sscanf(line, "jobs %d", &jobs) == 1 && jobs >= 0) sched_jobs = jobs;
+
+        char key[64], dist_key[64];
+        int n, reps, offset;
+        if (sscanf(line, "cell %63s %63s %d %d%n", key, dist_key, &n, &reps, &offset) != 4 || reps < 1) continue;
+        int algorithm = -1, dist = distributionFromKey(dist_key);
+        for (int a = 0; a < num_algorithms; a++) {
+            if (strcmp(algorithms[a].key, key) == 0) algorithm = a;
+        }
+        if (algorithm < 0 || dist < 0) {
+            fprintf(stderr, "Skipping unknown cell %s %s\n", key, dist_key);
+            continue;
+        }
+
+        baseline = (double*)realloc(baseline, reps * sizeof(double));
+        samples = (double*)realloc(samples, reps * sizeof(double));
+        const char *p = line + offset;
+        for (int r = 0; r < reps; r++) {
+            char *end;
+            baseline[r] = strtod(p, &end);
+            p = end;
+        }
+
+        // Measured exactly as runBenchmark does
+        if (jobs >= 0) {
+            BenchJob *cell_jobs = (BenchJob*)malloc(reps * sizeof(BenchJob));
+            for (int r = 0; r < reps; r++) {
+                cell_jobs[r] = (BenchJob){.algorithm = algorithm, .dist = dist, .n = n, .warmup = warmup,
+                                          .state = JOB_PENDING};
+            }
+            int failed = runJobs(cell_jobs, reps);
+            for (int r = 0; r < reps; r++) samples[r] = cell_jobs[r].m.seconds;
+            free(cell_jobs);
+            if (failed) {
+                fprintf(stderr, "Skipping %s on %s input at n=%d: a job timed out or failed\n", key, dist_key, n);
+                continue;
+            }
         } else {
-            arr[k] = R[j];
-            j++;
+            int *input = (int*)malloc((size_t)n * sizeof(int));
+            int *work = (int*)malloc((size_t)n * sizeof(int));
+            generateInput(input, n, dist, input_seed);
+            for (int r = 0; r < warmup + reps; r++) {
+                SortMeasurement m;
+                measureSort(algorithms[algorithm].sort, input, work, n, &m);
+                if (r >= warmup) samples[r - warmup] = m.seconds;
+            }
+            free(input);
+            free(work);
         }
-        k++;
+        cells++;
+
+        double delta;
+        double p_value = mannWhitneyU(baseline, reps, samples, reps, &delta);
+        double base_median = sampleMedian(baseline, reps), new_median = sampleMedian(samples, reps);
+        double change = base_median > 0 ? 100 * (new_median / base_median - 1) : 0;
+        if (p_value >= BASELINE_ALPHA || fabs(delta) < BASELINE_MIN_EFFECT) continue;
+
+        const char *verdict = "improved";
+        if (delta > 0) {
+            regressions++;
+            verdict = "slower";
+            if (change > config->threshold) {
+                failing++;
+                verdict = "REGRESSION";
+            }
+        } else {
+            improvements++;
+        }
+        printf("| %-10s | %-9s | %9d | %12.6f | %12.6f | %+7.1f%% | %+6.2f | %8.2g | %-11s |\n",
+               algorithms[algorithm].name, distribution_keys[dist], n, base_median, new_median, change, delta,
+               p_value, verdict);
+        fflush(stdout);
     }
+    printf("+------------+-----------+-----------+--------------+--------------+----------+--------+----------+-------------+\n");
+    printf("%d cells compared: %d slower (%d beyond %.1f%%), %d faster, %d unchanged "
+           "(Mann-Whitney p < %.2f, |delta| >= %.2f)\n", cells, regressions, failing, config->threshold,
+           improvements, cells - regressions - improvements, BASELINE_ALPHA, BASELINE_MIN_EFFECT);
+    if (failing > 0) status = 3;
 
-    while(i < n1) {
-        arr[k] = L[i];
-        i++;
-        k++;
+    free(baseline);
+    free(samples);
+    fclose(file);
+    return status;
+}
+
+// Empirical complexity analysis
+
+// Two-sided 95% Student t quantiles for 1..30 degrees of freedom
+static const double t_quantile_95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+// Least-squares fit of log t = a + b log n over points [first, last].
+// Returns the residual sum of squares; ci95 is the half-width of the
+// 95% confidence interval of b (0 when there are only two points).
+static double fitLogLog(const int sizes[], const double seconds[], int first, int last,
+                        double *slope, double *ci95, double *r_squared) {
+    int m = last - first + 1;
+    double mean_x = 0, mean_y = 0;
+    for (int i = first; i <= last; i++) {
+        mean_x += log(sizes[i]);
+        mean_y += log(seconds[i]);
     }
+    mean_x /= m;
+    mean_y /= m;
 
-    while(j < n2) {
-        arr[k] = R[j];
-        j++;
-        k++;
+    double sxx = 0, sxy = 0, syy = 0;
+    for (int i = first; i <= last; i++) {
+        double dx = log(sizes[i]) - mean_x, dy = log(seconds[i]) - mean_y;
+        sxx += dx * dx;
+        sxy += dx * dy;
+        syy += dy * dy;
     }
+    double b = sxx > 0 ? sxy / sxx : 0;
+    double sse = syy - b * sxy;
+    if (sse < 0) sse = 0;
 
-    free(L);
-    free(R);
+    *slope = b;
+    *r_squared = syy > 0 ? 1 - sse / syy : 1;
+    if (m > 2 && sxx > 0) {
+        int df = m - 2;
+        double t = df <= 30 ? t_quantile_95[df - 1] : 1.96;
+        *ci95 = t * sqrt(sse / df / sxx);
+    } else {
+        *ci95 = 0;
+    }
+    return sse;
 }
 
-void mergeSort(int arr[], int left, int right, int visualize) {
-    if(left < right) {
-        int mid = left + (right - left) / 2;
+// Time one algorithm at n = COMPLEXITY_MIN_SIZE, 2n, 4n, ... until its
+// budget would run out, then fit the growth exponent. Small sizes are
+// repeated for COMPLEXITY_MIN_SAMPLE seconds and the fastest run is kept.
+void measureComplexity(int algorithm, Distribution dist, double budget, ComplexityResult *r) {
+    double spent = 0;
+
+    memset(r, 0, sizeof(*r));
+    r->break_index = -1;
+    r->stop_reason = "max n";
+    for (int n = COMPLEXITY_MIN_SIZE; n <= COMPLEXITY_MAX_SIZE && r->num_points < COMPLEXITY_MAX_POINTS; n *= 2) {
+        int i = r->num_points;
+        if (isImpracticalRun(algorithm, dist, n)) {
+            r->stop_reason = "recursion";
+            break;
+        }
+        // Predict the next time from the last doubling, assuming at least linear growth
+        if (i >= 2) {
+            double growth = r->seconds[i - 1] / r->seconds[i - 2];
+            if (growth < 2) growth = 2;
+            if (spent + r->seconds[i - 1] * growth > budget) {
+                r->stop_reason = "budget";
+                break;
+            }
+        }
+
+        int *input = (int*)malloc((size_t)n * sizeof(int));
+        int *work = (int*)malloc((size_t)n * sizeof(int));
+        if (!input || !work) {
+            free(input);
+            free(work);
+            r->stop_reason = "memory";
+            break;
+        }
+        double setup = nowSeconds();
+        generateInput(input, n, dist, input_seed);
+
+        double best = 0, start = nowSeconds();
+        int reps = 0;
+        do {
+            double t = timeSort(algorithms[algorithm].sort, input, work, n);
+            if (reps == 0 || t < best) best = t;
+            reps++;
+        } while (nowSeconds() - start < COMPLEXITY_MIN_SAMPLE && reps < 50);
+        spent += nowSeconds() - setup;
+        free(input);
+        free(work);
 
-        mergeSort(arr, left, mid, visualize);
-        mergeSort(arr, mid + 1, right, visualize);
-        if(visualize) visualizeSort(arr, right+1, left, right, "MERGE SORT", 3);
-        merge(arr, left, mid, right, visualize);
+        r->sizes[i] = n;
+        r->seconds[i] = best > 0 ? best : 1e-9;
+        r->num_points++;
+    }
+    if (r->num_points < 2) return;
+
+    // Timings below COMPLEXITY_MIN_FIT_TIME are mostly call overhead
+    int last = r->num_points - 1;
+    r->fit_first = 0;
+    while (r->fit_first < last - 2 && r->seconds[r->fit_first] < COMPLEXITY_MIN_FIT_TIME) r->fit_first++;
+    double sse = fitLogLog(r->sizes, r->seconds, r->fit_first, last, &r->exponent, &r->ci95, &r->r_squared);
+
+    // Best single breakpoint: a change is reported when two segments of at
+    // least three points fit clearly better than one line and their slopes
+    // differ by more than COMPLEXITY_SLOPE_CHANGE
+    double best_sse = sse;
+    for (int k = r->fit_first + 2; k <= last - 2; k++) {
+        double b1, b2, ci, r2;
+        double split_sse = fitLogLog(r->sizes, r->seconds, r->fit_first, k, &b1, &ci, &r2) +
+                           fitLogLog(r->sizes, r->seconds, k, last, &b2, &ci, &r2);
+        if (split_sse < best_sse && split_sse < sse / 2 && fabs(b2 - b1) > COMPLEXITY_SLOPE_CHANGE) {
+            best_sse = split_sse;
+            r->break_index = k;
+            r->slope_before = b1;
+            r->slope_after = b2;
+        }
     }
 }
 
-int partition(int arr[], int low, int high, int visualize) {
-    int pivot = arr[high];
-    int i = (low - 1);
-    int temp;
+// Fitted exponents of the selected algorithms on one input distribution
+void printComplexityTable(Distribution dist, double budget, const int selected[]) {
+    printf("Empirical complexity (%s input, %.1f s budget per algorithm, n doubling from %d):\n",
+           distribution_keys[dist], budget, COMPLEXITY_MIN_SIZE);
+    printf("+------------+-----------+-----------+--------------+-----------------+-------+-------------------------------------+\n");
+    printf("| Algorithm  | Largest n | Stopped   | Time (s)     | Exponent (95%%)  | R^2   | Slope change                        |\n");
+    printf("+------------+-----------+-----------+--------------+-----------------+-------+-------------------------------------+\n");
+    for (int a = 0; a < num_algorithms; a++) {
+        if (selected && !selected[a]) continue;
 
-    for(int j = low; j <= high - 1; j++) {
-        if(visualize) visualizeSort(arr, high+1, j, high, "QUICK SORT", 4);
-        if(arr[j] < pivot) {
-            i++;
-            temp = arr[i];
-            arr[i] = arr[j];
-            arr[j] = temp;
-            if(visualize) visualizeSort(arr, high+1, i, j, "QUICK SORT", 4);
+        ComplexityResult r;
+        measureComplexity(a, dist, budget, &r);
+        if (r.num_points < 2) {
+            printf("| %-10s | %9s | %-9s | %12s | %15s | %5s | %-35s |\n", algorithms[a].name, "-",
+                   r.stop_reason, "-", "-", "-", "");
+            continue;
+        }
+
+        int last = r.num_points - 1;
+        char exponent[32], change[64] = "";
+        snprintf(exponent, sizeof(exponent), "%.2f +/- %.2f", r.exponent, r.ci95);
+        if (r.break_index >= 0) {
+            double kb = (double)r.sizes[r.break_index] * sizeof(int) / 1024;
+            snprintf(change, sizeof(change), "%.2f -> %.2f at n=%d (%.0f %s)", r.slope_before, r.slope_after,
+                     r.sizes[r.break_index], kb >= 1024 ? kb / 1024 : kb, kb >= 1024 ? "MB" : "KB");
         }
+        printf("| %-10s | %9d | %-9s | %12.6f | %15s | %5.3f | %-35s |\n", algorithms[a].name,
+               r.sizes[last], r.stop_reason, r.seconds[last], exponent, r.r_squared, change);
+        fflush(stdout);
     }
+    printf("+------------+-----------+-----------+--------------+-----------------+-------+-------------------------------------+\n");
+}
 
-    temp = arr[i + 1];
-    arr[i + 1] = arr[high];
-    arr[high] = temp;
+// Non-interactive complexity analysis (--complexity)
+int runComplexityAnalysis(BenchConfig *config) {
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (!config->distributions[d]) continue;
+        printComplexityTable(d, complexity_budget, config->selected);
+        printf("\n");
+    }
+    return 0;
+}
 
-    return (i + 1);
+// Selection benchmark (--bench --select): nth element, top-k and partial
+// sort against a full introsort at several k/n ratios. Every operation
+// works on a fresh copy of the input and is checked against the full sort.
+enum { SELECT_FULL_SORT, SELECT_NTH, SELECT_TOPK, SELECT_PARTIAL, NUM_SELECT_OPS };
+
+const char *select_op_keys[NUM_SELECT_OPS] = {"sort", "nth_element", "topk", "partial_sort"};
+const double select_ratios[] = {0.0001, 0.001, 0.01, 0.1, 0.5};
+
+static double timeSelectOp(int op, int input[], int work[], int out[], int n, int k) {
+    memcpy(work, input, n * sizeof(int));
+    double start = nowSeconds();
+    switch (op) {
+        case SELECT_FULL_SORT: introSort(work, n, 0); break;
+        case SELECT_NTH:       nthElement(work, n, k - 1); break;
+        case SELECT_TOPK:      topK(work, n, k, out); break;
+        case SELECT_PARTIAL:   partialSort(work, n, k); break;
+    }
+    return nowSeconds() - start;
 }
 
-void quickSort(int arr[], int low, int high, int visualize) {
-    if(low < high) {
-        int pi = partition(arr, low, high, visualize);
+// Nonzero if the last run of op produced the k smallest values of sorted[]
+static int checkSelectOp(int op, const int work[], const int out[], const int sorted[], int k) {
+    switch (op) {
+        case SELECT_NTH:     return work[k - 1] == sorted[k - 1];
+        case SELECT_TOPK:    return memcmp(out, sorted, k * sizeof(int)) == 0;
+        case SELECT_PARTIAL: return memcmp(work, sorted, k * sizeof(int)) == 0;
+    }
+    return 1;
+}
+
+int runSelectionBenchmark(BenchConfig *config) {
+    int num_ratios = sizeof(select_ratios) / sizeof(select_ratios[0]);
+    double *samples = (double*)malloc(config->reps * sizeof(double));
+    int first = 1, status = 0;
+
+    if (config->format == FORMAT_CSV) {
+        printf("operation,distribution,size,k,k_over_n,reps,min_s,median_s,p95_s,speedup_vs_sort\n");
+    } else if (config->format == FORMAT_JSON) {
+        printf("{\"threads\": %d, \"seed\": %llu, \"warmup\": %d, \"results\": [\n",
+               num_threads, (unsigned long long)input_seed, config->warmup);
+    } else {
+        printf("+-----------+-----------+-----------+-----------+--------------+--------------+--------------+--------------+\n");
+        printf("| Input     | Size      | k/n       | k         | Sort (s)     | nth_element  | Top-k heap   | Partial sort |\n");
+        printf("+-----------+-----------+-----------+-----------+--------------+--------------+--------------+--------------+\n");
+    }
+
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (!config->distributions[d]) continue;
+
+        for (int s = 0; s < config->num_sizes; s++) {
+            int n = config->sizes[s];
+            int *input = (int*)malloc(n * sizeof(int));
+            int *work = (int*)malloc(n * sizeof(int));
+            int *sorted = (int*)malloc(n * sizeof(int));
+            int *out = (int*)malloc(n * sizeof(int));
 
-        quickSort(arr, low, pi - 1, visualize);
-        quickSort(arr, pi + 1, high, visualize);
+            generateInput(input, n, d, input_seed);
+            memcpy(sorted, input, n * sizeof(int));
+            introSort(sorted, n, 0);
+
+            int last_k = 0;
+            for (int r = 0; r < num_ratios; r++) {
+                int k = (int)(select_ratios[r] * n);
+                if (k < 1) k = 1;
+                // Small inputs collapse several ratios onto k = 1
+                if (k == last_k) continue;
+                last_k = k;
+
+                BenchStats stats[NUM_SELECT_OPS];
+                for (int op = 0; op < NUM_SELECT_OPS; op++) {
+                    for (int rep = 0; rep < config->warmup + config->reps; rep++) {
+                        double seconds = timeSelectOp(op, input, work, out, n, k);
+                        if (rep >= config->warmup) samples[rep - config->warmup] = seconds;
+                    }
+                    if (!checkSelectOp(op, work, out, sorted, k)) {
+                        fprintf(stderr, "%s returned wrong values on %s input at n=%d, k=%d\n",
+                                select_op_keys[op], distribution_keys[d], n, k);
+                        status = 2;
+                    }
+                    computeBenchStats(samples, config->reps, n, &stats[op]);
+                }
+
+                for (int op = 0; op < NUM_SELECT_OPS; op++) {
+                    double speedup = stats[op].median > 0 ? stats[SELECT_FULL_SORT].median / stats[op].median : 0;
+                    if (config->format == FORMAT_CSV) {
+                        printf("%s,%s,%d,%d,%g,%d,%.9f,%.9f,%.9f,%.3f\n", select_op_keys[op], distribution_keys[d],
+                               n, k, (double)k / n, config->reps, stats[op].min, stats[op].median, stats[op].p95,
+                               speedup);
+                    } else if (config->format == FORMAT_JSON) {
+                        printf("%s  {\"operation\": \"%s\", \"distribution\": \"%s\", \"size\": %d, \"k\": %d, "
+                               "\"k_over_n\": %g, \"reps\": %d, \"min_s\": %.9f, \"median_s\": %.9f, "
+                               "\"p95_s\": %.9f, \"speedup_vs_sort\": %.3f}", first ? "" : ",\n",
+                               select_op_keys[op], distribution_keys[d], n, k, (double)k / n, config->reps,
+                               stats[op].min, stats[op].median, stats[op].p95, speedup);
+                        first = 0;
+                    }
+                }
+                if (config->format == FORMAT_TABLE) {
+                    printf("| %-9s | %9d | %9g | %9d | %12.6f |", distribution_keys[d], n, (double)k / n, k,
+                           stats[SELECT_FULL_SORT].median);
+                    for (int op = SELECT_NTH; op < NUM_SELECT_OPS; op++) {
+                        printf(" %10.1fx |", stats[SELECT_FULL_SORT].median / stats[op].median);
+                    }
+                    printf("\n");
+                }
+                fflush(stdout);
+            }
+
+            free(input);
+            free(work);
+            free(sorted);
+            free(out);
+        }
+    }
+
+    if (config->format == FORMAT_JSON) {
+        printf("\n]}\n");
+    } else if (config->format == FORMAT_TABLE) {
+        printf("+-----------+-----------+-----------+-----------+--------------+--------------+--------------+--------------+\n");
+        printf("Selection columns show the speedup over the full sort (median of %d runs)\n", config->reps);
     }
-    if(visualize && low == 0 && high > low)
-        visualizeSort(arr, high+1, -1, -1, "QUICK SORT - PARTITION", 4);
+    free(samples);
+    return status;
 }
 
-void printArray(int arr[], int n) {
-    for(int i = 0; i < n; i++) {
-        if(i % 10 == 0) printf("\n");
-        printf("[%3d] ", arr[i]);
+// Benchmark scheduler
+
+// Nonzero if cpu is the lowest-numbered SMT sibling of its core (or the
+// topology is not reported)
+static int firstSmtSibling(int cpu) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    FILE *file = fopen(path, "r");
+    if (!file) return 1;
+    int first = cpu;
+    if (fscanf(file, "%d", &first) != 1) first = cpu;
+    fclose(file);
+    return first == cpu;
+}
+
+// CPUs this process may run on, one per core with --one-per-core
+static int schedulerCpus(int cpus[], int max) {
+    cpu_set_t set;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        cpus[0] = 0;
+        return 1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        if (sched_one_per_core && !firstSmtSibling(cpu)) continue;
+        cpus[count++] = cpu;
+    }
+    return count > 0 ? count : 1;
+}
+
+// Parallel sorts run as jobs of their own, on num_threads CPUs
+static int jobIsParallel(const BenchJob *job) {
+    void (*sort)(int arr[], int n) = algorithms[job->algorithm].sort;
+    return sort == runParallelMergeSort || sort == runParallelQuickSort;
+}
+
+// Relative cost of a job, for longest-first launching and the ETA
+static double jobWork(const BenchJob *job) {
+    double n = job->n > 2 ? job->n : 2;
+    void (*sort)(int arr[], int n) = algorithms[job->algorithm].sort;
+    double run = sort == runSelectionSort || sort == runBubbleSort ? n * n / 4 : n * log2(n);
+    return (job->warmup + 1) * run;
+}
+
+// Worker process: pin to the CPU set, build the input locally and time
+// the run with the given number of threads
+static void runJobProcess(BenchJob *job, const cpu_set_t *set, int threads, int fd) {
+    // Pool threads and perf counters belong to the parent; start afresh
+    memset(&pool, 0, sizeof(pool));
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (perf_fds[e] >= 0) close(perf_fds[e]);
+        perf_fds[e] = -2;
+    }
+    num_threads = threads;
+
+    // Pinning before allocating makes first touch place the pages on
+    // this CPU's NUMA node
+    job->pin_error = sched_setaffinity(0, sizeof(*set), set) == 0 ? 0 : errno;
+
+    int n = job->n;
+    int *source = (int*)malloc(n * sizeof(int));
+    int *work = (int*)malloc(n * sizeof(int));
+    generateInput(source, n, job->dist, input_seed);
+    for (int w = 0; w < job->warmup; w++) {
+        measureSort(algorithms[job->algorithm].sort, source, work, n, &job->m);
+    }
+    measureSort(algorithms[job->algorithm].sort, source, work, n, &job->m);
+    job->sorted = 1;
+    for (int i = 1; i < n && job->sorted; i++) {
+        job->sorted = work[i - 1] <= work[i];
+    }
+    job->state = JOB_DONE;
+    ssize_t written = write(fd, job, sizeof(*job));
+    _exit(written == (ssize_t)sizeof(*job) ? 0 : 1);
+}
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    int job;
+    double deadline;
+} JobSlot;
+
+// Run every job in its own forked process, at most sched_jobs at a time
+// (default one per usable CPU), each pinned to a different CPU. Jobs are
+// launched longest first. Parallel sorts go last, one at a time, pinned
+// to num_threads CPUs with the pool at num_threads threads. A job still
+// running after sched_timeout seconds is killed. Progress and the
+// estimated finish time are drawn on stderr from the estimated work of
+// the finished jobs. Returns the number of jobs that timed out or failed.
+int runJobs(BenchJob jobs[], int count) {
+    if (count <= 0) return 0;
+    int cpus[CPU_SETSIZE];
+    int num_cpus = schedulerCpus(cpus, CPU_SETSIZE);
+    int slots = sched_jobs > 0 && sched_jobs < num_cpus ? sched_jobs : num_cpus;
+    if (slots > count) slots = count;
+    int show_progress = isatty(STDERR_FILENO);
+
+    // Longest first: a selection sort launched last would otherwise
+    // finish long after the other slots went idle
+    int *order = (int*)malloc(count * sizeof(int));
+    double total_work = 0, done_work = 0;
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        int parallel = jobIsParallel(&jobs[i]);
+        double work = jobWork(&jobs[i]);
+        while (j > 0 && (jobIsParallel(&jobs[order[j - 1]]) > parallel ||
+                         (jobIsParallel(&jobs[order[j - 1]]) == parallel && jobWork(&jobs[order[j - 1]]) < work))) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+        total_work += work;
+        jobs[i].state = JOB_PENDING;
+    }
+
+    JobSlot *slot = (JobSlot*)calloc(slots, sizeof(JobSlot));
+    int next = 0, finished = 0, failures = 0, running = 0, exclusive = 0;
+    int parallel_cpus = num_threads < num_cpus ? num_threads : num_cpus;
+    double start = nowSeconds();
+
+    while (finished < count) {
+        // Fill idle slots; a parallel job waits for every slot to drain
+        // and keeps the others idle while it runs
+        for (int s = 0; s < slots && next < count && !exclusive; s++) {
+            if (slot[s].pid) continue;
+            int fds[2];
+            BenchJob *job = &jobs[order[next]];
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (jobIsParallel(job)) {
+                if (running > 0) break;
+                for (int c = 0; c < parallel_cpus; c++) CPU_SET(cpus[c], &set);
+                exclusive = 1;
+            } else {
+                CPU_SET(cpus[s], &set);
+            }
+            pid_t pid = -1;
+            fflush(NULL);
+            if (pipe(fds) == 0) {
+                pid = fork();
+                if (pid < 0) {
+                    close(fds[0]);
+                    close(fds[1]);
+                }
+            }
+            if (pid < 0) {
+                perror("Cannot start benchmark job");
+                exclusive = 0;
+                job->state = JOB_FAILED;
+                next++;
+                finished++;
+                failures++;
+                continue;
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                runJobProcess(job, &set, exclusive ? num_threads : 1, fds[1]);
+            }
+            close(fds[1]);
+            running++;
+            slot[s].pid = pid;
+            slot[s].fd = fds[0];
+            slot[s].job = order[next++];
+            slot[s].deadline = sched_timeout > 0 ? nowSeconds() + sched_timeout : 0;
+            job->state = JOB_RUNNING;
+        }
+
+        // Wait for a result, a deadline or the next progress refresh
+        fd_set readable;
+        FD_ZERO(&readable);
+        int max_fd = -1;
+        double wait = 0.25, now = nowSeconds();
+        for (int s = 0; s < slots; s++) {
+            if (!slot[s].pid) continue;
+            FD_SET(slot[s].fd, &readable);
+            if (slot[s].fd > max_fd) max_fd = slot[s].fd;
+            if (slot[s].deadline > 0 && slot[s].deadline - now < wait) wait = slot[s].deadline - now;
+        }
+        if (wait < 0) wait = 0;
+        struct timeval timeout = {(long)wait, (long)((wait - (long)wait) * 1e6)};
+        if (max_fd >= 0 && select(max_fd + 1, &readable, NULL, NULL, &timeout) < 0) FD_ZERO(&readable);
+
+        now = nowSeconds();
+        for (int s = 0; s < slots; s++) {
+            if (!slot[s].pid) continue;
+            BenchJob *job = &jobs[slot[s].job];
+            if (FD_ISSET(slot[s].fd, &readable)) {
+                BenchJob result;
+                if (read(slot[s].fd, &result, sizeof(result)) == (ssize_t)sizeof(result)) {
+                    job->m = result.m;
+                    job->sorted = result.sorted;
+                    job->pin_error = result.pin_error;
+                    job->state = JOB_DONE;
+                    if (job->pin_error) {
+                        fprintf(stderr, "Warning: %s on %s input at n=%d ran unpinned: %s\n",
+                                algorithms[job->algorithm].key, distribution_keys[job->dist], job->n,
+                                strerror(job->pin_error));
+                    }
+                } else {
+                    job->state = JOB_FAILED;
+                }
+            } else if (slot[s].deadline > 0 && now >= slot[s].deadline) {
+                kill(slot[s].pid, SIGKILL);
+                job->state = JOB_TIMEOUT;
+            } else {
+                continue;
+            }
+            waitpid(slot[s].pid, NULL, 0);
+            close(slot[s].fd);
+            slot[s].pid = 0;
+            running--;
+            if (jobIsParallel(job)) exclusive = 0;
+            if (job->state != JOB_DONE) failures++;
+            finished++;
+            done_work += jobWork(job);
+        }
+
+        if (show_progress) {
+            char status[96];
+            double elapsed = now - start;
+            if (done_work > 0 && finished < count) {
+                snprintf(status, sizeof(status), "%d/%d jobs, %d at a time, ETA %.0f s", finished, count, slots,
+                         elapsed * (total_work - done_work) / done_work);
+            } else {
+                snprintf(status, sizeof(status), "%d/%d jobs, %d at a time, %.1f s", finished, count, slots, elapsed);
+            }
+            printProgressBar(stderr, total_work > 0 ? done_work / total_work : 1, 40, status);
+        }
+    }
+    if (show_progress) fprintf(stderr, "\n");
+
+    free(slot);
+    free(order);
+    return failures;
+}
+
+// Hardware performance counters
+
+static void perfOpen() {
+    static const struct { unsigned type; unsigned long long config; } events[NUM_PERF_EVENTS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    };
+
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+// Nonzero if at least one hardware counter could be opened
+int perfAvailable() {
+    if (perf_fds[0] == -2) perfOpen();
+    for (int e = 0; e < PERF_PAGE_FAULTS; e++) {
+        if (perf_fds[e] >= 0) return 1;
+    }
+    return 0;
+}
+
+void perfStart() {
+    if (perf_fds[0] == -2) perfOpen();
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (perf_fds[e] < 0) continue;
+        ioctl(perf_fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perfStop(PerfSample *sample) {
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        sample->valid[e] = 0;
+        sample->values[e] = 0;
+        if (perf_fds[e] < 0) continue;
+        ioctl(perf_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        sample->valid[e] = read(perf_fds[e], &sample->values[e], sizeof(long long)) == sizeof(long long);
+    }
+}
+
+// Comparisons normalized by n*log2(n); 0 when operation counting is off
+double comparisonsPerNLogN(long long comparisons, int n) {
+    if (n < 2) return 0;
+    return comparisons / (n * log2((double)n));
+}
+
+// Print header with ASCII art
+void printHeader() {
+    printf(CYAN BOLD);
+    printf("╔══════════════════════════════════════════════════════╗\n");
+    printf("║                                                      ║\n");
+    printf("║      SORTING ALGORITHM VISUALIZER                    ║\n");
+    printf("║      ===========================                    ║\n");
+    printf("║                                                      ║\n");
+    printf("╚══════════════════════════════════════════════════════╝\n");
+    printf(RESET);
+}
+
+// Print progress bar, followed by an optional status
+void printProgressBar(FILE *out, float progress, int width, const char *status) {
+    fprintf(out, "[");
+    int pos = width * progress;
+    for (int i = 0; i < width; i++) {
+        if (i < pos) fprintf(out, "=");
+        else if (i == pos) fprintf(out, ">");
+        else fprintf(out, " ");
+    }
+    fprintf(out, "] %d%% %s\033[K\r", (int)(progress * 100.0), status ? status : "");
+    fflush(out);
+}
+
+// Print a horizontal rule for the performance analysis table
+void printTableRule(int columns) {
+    printf("+----------+");
+    for (int i = 0; i < columns; i++) {
+        printf("---------------+");
     }
     printf("\n");
 }
 
-void copyArray(int source[], int dest[], int n) {
-    for(int i = 0; i < n; i++) {
-        dest[i] = source[i];
+// Wall-clock time in seconds. clock() sums CPU time over all threads,
+// which would hide any speedup from the parallel sorts.
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sort scratch arena
+
+static void scratchTrackPeak() {
+    size_t live = scratch_arena.used + scratch_arena.heap_live;
+    if (live > scratch_arena.peak) scratch_arena.peak = live;
+    if (live > scratch_arena.high_water) scratch_arena.high_water = live;
+}
+
+void *scratchAlloc(size_t bytes) {
+    size_t rounded = (bytes + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    void *block;
+
+    scratch_arena.allocations++;
+    scratch_arena.bytes += bytes;
+    if (scratch_arena.capacity - scratch_arena.used >= rounded) {
+        block = scratch_arena.base + scratch_arena.used;
+        scratch_arena.used += rounded;
+    } else {
+        // The size is kept in a header in front of the block
+        char *raw = (char*)malloc(rounded + SCRATCH_ALIGN);
+        if (!raw) return NULL;
+        *(size_t*)raw = rounded;
+        block = raw + SCRATCH_ALIGN;
+        scratch_arena.heap_live += rounded;
+        scratch_arena.heap_allocations++;
+    }
+    scratchTrackPeak();
+    return block;
+}
+
+void *scratchCalloc(size_t count, size_t size) {
+    void *block = scratchAlloc(count * size);
+    if (block) memset(block, 0, count * size);
+    return block;
+}
+
+// Releasing an arena block also releases everything allocated after it
+void scratchFree(void *block) {
+    char *p = (char*)block;
+    if (!p) return;
+    if (p >= scratch_arena.base && p < scratch_arena.base + scratch_arena.capacity) {
+        size_t offset = p - scratch_arena.base;
+        if (offset < scratch_arena.used) scratch_arena.used = offset;
+        return;
+    }
+    p -= SCRATCH_ALIGN;
+    scratch_arena.heap_live -= *(size_t*)p;
+    free(p);
+}
+
+// Whether a sort may take this much scratch under max_scratch_bytes
+int scratchFits(size_t bytes) {
+    return max_scratch_bytes < 0 || bytes <= (unsigned long long)max_scratch_bytes;
+}
+
+// Start a run: clear the statistics and make the arena hold at least
+// `expected` bytes plus slack, or the largest peak seen so far
+void scratchReset(size_t expected) {
+    size_t want = expected + SCRATCH_SLACK;
+    if (scratch_arena.high_water > want) want = scratch_arena.high_water;
+    if (max_scratch_bytes >= 0 && want > (unsigned long long)max_scratch_bytes + SCRATCH_SLACK) {
+        want = max_scratch_bytes + SCRATCH_SLACK;
+    }
+    if (want > scratch_arena.capacity) {
+        free(scratch_arena.base);
+        scratch_arena.base = (char*)aligned_alloc(SCRATCH_ALIGN, (want + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1));
+        scratch_arena.capacity = scratch_arena.base ? want : 0;
+    }
+    scratch_arena.used = 0;
+    scratch_arena.allocations = 0;
+    scratch_arena.heap_allocations = 0;
+    scratch_arena.bytes = 0;
+    scratch_arena.peak = 0;
+}
+
+// Peak resident set size of the whole process
+long peakRssKB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Copy source into work and return the seconds spent sorting it
+double timeSort(void (*sort)(int arr[], int n), int source[], int work[], int n) {
+    double start, end;
+
+    copyArray(source, work, n);
+    scratchReset((size_t)n * sizeof(int));
+    start = nowSeconds();
+    sort(work, n);
+    end = nowSeconds();
+    return end - start;
+}
+
+// Like timeSort, but also collects hardware and operation counters
+void measureSort(void (*sort)(int arr[], int n), int source[], int work[], int n, SortMeasurement *m) {
+    double start;
+
+    copyArray(source, work, n);
+#ifdef COUNT_OPERATIONS
+    memset(&op_counts, 0, sizeof(op_counts));
+#endif
+    scratchReset((size_t)n * sizeof(int));
+    perfStart();
+    start = nowSeconds();
+    sort(work, n);
+    m->seconds = nowSeconds() - start;
+    perfStop(&m->perf);
+    m->allocations = scratch_arena.allocations;
+    m->scratch_bytes = scratch_arena.bytes;
+    m->peak_scratch = scratch_arena.peak;
+#ifdef COUNT_OPERATIONS
+    m->ops = op_counts;
+#else
+    memset(&m->ops, 0, sizeof(m->ops));
+#endif
+}
+
+// Print comparison chart
+void printComparisonChart(double times[], const char* names[], int num_sorts) {
+    printf(BOLD "\nPERFORMANCE COMPARISON CHART:\n" RESET);
+    printf("(Bar length represents relative speed)\n\n");
+
+    // Find maximum time for scaling
+    double max_time = 0;
+    for (int i = 0; i < num_sorts; i++) {
+        if (times[i] > max_time) max_time = times[i];
     }
+
+    // Print bars
+    for (int i = 0; i < num_sorts; i++) {
+        printf("%-12s: ", names[i]);
+
+        // Choose color based on algorithm
+        if (strcmp(names[i], "Selection") == 0) printf(YELLOW);
+        else if (strcmp(names[i], "Bubble") == 0) printf(GREEN);
+        else if (strcmp(names[i], "Merge") == 0) printf(BLUE);
+        else if (strcmp(names[i], "Quick") == 0) printf(MAGENTA);
+        else if (strcmp(names[i], "Intro") == 0) printf(CYAN);
+        else if (strcmp(names[i], "BU Merge") == 0) printf(BLUE);
+        else if (strcmp(names[i], "Par Merge") == 0) printf(BLUE);
+        else if (strcmp(names[i], "Par Quick") == 0) printf(MAGENTA);
+        else if (strcmp(names[i], "Counting") == 0) printf(GREEN);
+        else if (strcmp(names[i], "Radix") == 0) printf(YELLOW);
+        else if (strcmp(names[i], "AVX2 Merge") == 0) printf(CYAN);
+        else if (strcmp(names[i], "TimSort") == 0) printf(GREEN);
+        else if (strcmp(names[i], "PDQ") == 0) printf(MAGENTA);
+        else if (strcmp(names[i], "Multiway") == 0) printf(BLUE);
+
+        int bar_length = 50 - (int)((times[i] / max_time) * 50);
+        if (bar_length < 1) bar_length = 1;
+
+        for (int j = 0; j < bar_length; j++) {
+            printf("█");
+        }
+        printf(" %12.6f seconds\n" RESET, times[i]);
+    }
+
+    // Determine fastest and slowest
+    double fastest = times[0];
+    double slowest = times[0];
+    int fastest_idx = 0, slowest_idx = 0;
+
+    for (int i = 1; i < num_sorts; i++) {
+        if (times[i] < fastest) {
+            fastest = times[i];
+            fastest_idx = i;
+        }
+        if (times[i] > slowest) {
+            slowest = times[i];
+            slowest_idx = i;
+        }
+    }
+
+    printf("\n" BOLD "Analysis:\n" RESET);
+    printf("• Fastest: %s Sort (%.6f seconds)\n", names[fastest_idx], fastest);
+    printf("• Slowest: %s Sort (%.6f seconds)\n", names[slowest_idx], slowest);
+    printf("• Speed ratio (Slowest/Fastest): %.2fx\n", slowest/fastest);
+}
+
+// Terminal renderer used by trace replay. Each frame is composed in
+// viz_frame and only the rows that differ from what is already on screen are
+// redrawn, so a frame costs one write() regardless of the array size.
+typedef struct {
+    int length;          // Elements being visualized (0 = use the caller's n)
+    int rows;            // Bars on screen; each bar covers one bucket of elements
+    int frames;          // Frames drawn since visualizeBegin
+    int steps;           // Trace events coalesced into the next frame
+    int last_steps;      // Trace events coalesced into the last drawn frame
+    int color;
+    double last_frame;   // nowSeconds() when the last frame was drawn
+    double render_cpu;   // CPU seconds spent composing the last frame
+    char title[64];      // Title currently on screen
+    char screen[VIZ_MAX_ROWS][VIZ_ROW_BYTES];  // Bars currently on screen
+} VisualizerState;
+
+static VisualizerState viz;
+static char viz_frame[VIZ_MAX_ROWS * VIZ_ROW_BYTES + 4096];
+
+static const char *vizColor(int color) {
+    switch(color) {
+        case 1: return YELLOW;
+        case 2: return GREEN;
+        case 3: return BLUE;
+        case 4: return MAGENTA;
+    }
+    return "";
+}
+
+static double threadCpuSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Start a new visualization of an n-element array on a fresh screen
+void visualizeBegin(int n) {
+    memset(&viz, 0, sizeof(viz));
+    viz.length = n;
+}
+
+static void drawFrame(int arr[], int n, int index1, int index2, const char* sortName, int color) {
+    double cpu_start = threadCpuSeconds();
+    int length = viz.length > 0 ? viz.length : n;
+    size_t pos = 0;
+    if (length <= 0) return;
+
+    // Anything printed with stdio must reach the terminal before the frame
+    fflush(stdout);
+
+    if (viz.frames == 0) {
+        printf(CLEAR);
+        printHeader();
+        fflush(stdout);
+        viz.title[0] = '\0';
+        viz.rows = length < VIZ_MAX_ROWS ? length : VIZ_MAX_ROWS;
+        for (int r = 0; r < VIZ_MAX_ROWS; r++) viz.screen[r][0] = '\0';
+    }
+
+    if (strcmp(viz.title, sortName) != 0 || viz.color != color) {
+        snprintf(viz.title, sizeof(viz.title), "%s", sortName);
+        viz.color = color;
+        pos += snprintf(viz_frame + pos, sizeof(viz_frame) - pos,
+                        "\x1b[%d;1H" BOLD "%s%s" RESET "\x1b[K"
+                        "\x1b[%d;1H====================================",
+                        VIZ_FIRST_ROW - 3, vizColor(color), sortName, VIZ_FIRST_ROW - 2);
+    }
+
+    // Scale bars between the smallest and largest value currently in the array
+    int min_val = arr[0], max_val = arr[0];
+    for (int i = 1; i < length; i++) {
+        if (arr[i] < min_val) min_val = arr[i];
+        if (arr[i] > max_val) max_val = arr[i];
+    }
+    double range = (double)max_val - min_val;
+    int bucket = (length + viz.rows - 1) / viz.rows;
+
+    // Large arrays are drawn one bucket per row, each bar showing the bucket's mean
+    for (int r = 0; r < viz.rows; r++) {
+        int low = r * bucket;
+        int high = low + bucket < length ? low + bucket : length;
+        char line[VIZ_ROW_BYTES];
+        size_t len = 0;
+
+        if (low < high) {
+            long long sum = 0;
+            for (int i = low; i < high; i++) sum += arr[i];
+            double mean = (double)sum / (high - low);
+            int bar_length = range > 0 ? 1 + (int)((mean - min_val) * (VIZ_BAR_WIDTH - 1) / range)
+                                       : VIZ_BAR_WIDTH;
+            int highlight = (index1 >= low && index1 < high) || (index2 >= low && index2 < high);
+
+            len += snprintf(line + len, sizeof(line) - len, "%s",
+                            highlight ? RED BOLD : vizColor(color));
+            for (int j = 0; j < bar_length; j++) {
+                len += snprintf(line + len, sizeof(line) - len, "█");
+            }
+            if (bucket == 1) {
+                snprintf(line + len, sizeof(line) - len, " %3d" RESET, arr[low]);
+            } else {
+                snprintf(line + len, sizeof(line) - len, " %.0f" RESET, mean);
+            }
+        } else {
+            line[0] = '\0';
+        }
+
+        if (strcmp(line, viz.screen[r]) != 0) {
+            pos += snprintf(viz_frame + pos, sizeof(viz_frame) - pos, "\x1b[%d;1H%s\x1b[K",
+                            VIZ_FIRST_ROW + r, line);
+            memcpy(viz.screen[r], line, sizeof(line));
+        }
+    }
+
+    viz.frames++;
+    viz.last_steps = viz.steps;
+    viz.steps = 0;
+    viz.render_cpu = threadCpuSeconds() - cpu_start;
+
+    pos += snprintf(viz_frame + pos, sizeof(viz_frame) - pos,
+                    "\x1b[%d;1H" CYAN "frame %d | %d events/frame | render %.1f us | %d elements, %d per row"
+                    RESET "\x1b[K\x1b[%d;1H",
+                    VIZ_FIRST_ROW + viz.rows + 1, viz.frames, viz.last_steps, viz.render_cpu * 1e6,
+                    length, bucket, VIZ_FIRST_ROW + viz.rows + 2);
+
+    ssize_t written = 0;
+    while ((size_t)written < pos) {
+        ssize_t w = write(STDOUT_FILENO, viz_frame + written, pos - written);
+        if (w <= 0) break;
+        written += w;
+    }
+    viz.last_frame = nowSeconds();
+}
+
+
+// Modified sorting functions with visualization
+TRACEABLE void selectionSortBody(int arr[], int n, const int traced) {
+    int i, j, min_idx, temp;
+
+    for(i = 0; i < n - 1; i++) {
+        min_idx = i;
+        for(j = i + 1; j < n; j++) {
+            TRACE_COMPARE(traced, j, min_idx);
+            COUNT_COMPARISONS(1);
+            if(arr[j] < arr[min_idx]) {
+                min_idx = j;
+            }
+        }
+        // Swap
+        temp = arr[min_idx];
+        arr[min_idx] = arr[i];
+        arr[i] = temp;
+        COUNT_SWAPS(1);
+        TRACE_SWAP(traced, i, min_idx);
+    }
+}
+
+// The visualize flag is tested once here rather than in the inner loops
+void selectionSort(int arr[], int n, int visualize) {
+    if (visualize) selectionSortBody(arr, n, 1);
+    else selectionSortBody(arr, n, 0);
+}
+
+TRACEABLE void bubbleSortBody(int arr[], int n, const int traced) {
+    int i, j, temp;
+    for(i = 0; i < n - 1; i++) {
+        for(j = 0; j < n - i - 1; j++) {
+            TRACE_COMPARE(traced, j, j + 1);
+            COUNT_COMPARISONS(1);
+            if(arr[j] > arr[j + 1]) {
+                temp = arr[j];
+                arr[j] = arr[j + 1];
+                arr[j + 1] = temp;
+                COUNT_SWAPS(1);
+                TRACE_SWAP(traced, j, j + 1);
+            }
+        }
+    }
+}
+
+void bubbleSort(int arr[], int n, int visualize) {
+    if (visualize) bubbleSortBody(arr, n, 1);
+    else bubbleSortBody(arr, n, 0);
+}
+
+TRACEABLE void mergeBody(int arr[], int left, int mid, int right, const int traced) {
+    int i, j, k;
+    int n1 = mid - left + 1;
+    int n2 = right - mid;
+
+    int *L = (int*)scratchAlloc(n1 * sizeof(int));
+    int *R = (int*)scratchAlloc(n2 * sizeof(int));
+
+    for(i = 0; i < n1; i++)
+        L[i] = arr[left + i];
+    for(j = 0; j < n2; j++)
+        R[j] = arr[mid + 1 + j];
+    COUNT_MOVES(2 * (n1 + n2));
+
+    i = 0;
+    j = 0;
+    k = left;
+
+    while(i < n1 && j < n2) {
+        TRACE_COMPARE(traced, left + i, mid + 1 + j);
+        COUNT_COMPARISONS(1);
+        if(L[i] <= R[j]) {
+            TRACE_WRITE(traced, arr, k, L[i]);
+            arr[k] = L[i];
+            i++;
+        } else {
+            TRACE_WRITE(traced, arr, k, R[j]);
+            arr[k] = R[j];
+            j++;
+        }
+        k++;
+    }
+
+    while(i < n1) {
+        TRACE_WRITE(traced, arr, k, L[i]);
+        arr[k] = L[i];
+        i++;
+        k++;
+    }
+
+    while(j < n2) {
+        TRACE_WRITE(traced, arr, k, R[j]);
+        arr[k] = R[j];
+        j++;
+        k++;
+    }
+
+    scratchFree(R);
+    scratchFree(L);
+}
+
+void merge(int arr[], int left, int mid, int right, int visualize) {
+    if (visualize) mergeBody(arr, left, mid, right, 1);
+    else mergeBody(arr, left, mid, right, 0);
+}
+
+static void mergeSortPlain(int arr[], int left, int right);
+static void mergeSortTraced(int arr[], int left, int right);
+
+TRACEABLE void mergeSortBody(int arr[], int left, int right, const int traced) {
+    if(left < right) {
+        int mid = left + (right - left) / 2;
+
+        if (traced) {
+            mergeSortTraced(arr, left, mid);
+            mergeSortTraced(arr, mid + 1, right);
+        } else {
+            mergeSortPlain(arr, left, mid);
+            mergeSortPlain(arr, mid + 1, right);
+        }
+        mergeBody(arr, left, mid, right, traced);
+    }
+}
+
+static void mergeSortPlain(int arr[], int left, int right) { mergeSortBody(arr, left, right, 0); }
+static void mergeSortTraced(int arr[], int left, int right) { mergeSortBody(arr, left, right, 1); }
+
+void mergeSort(int arr[], int left, int right, int visualize) {
+    if (visualize) mergeSortTraced(arr, left, right);
+    else mergeSortPlain(arr, left, right);
+}
+
+TRACEABLE int partitionBody(int arr[], int low, int high, const int traced) {
+    int pivot = arr[high];
+    int i = (low - 1);
+    int temp;
+
+    for(int j = low; j <= high - 1; j++) {
+        TRACE_COMPARE(traced, j, high);
+        COUNT_COMPARISONS(1);
+        if(arr[j] < pivot) {
+            i++;
+            temp = arr[i];
+            arr[i] = arr[j];
+            arr[j] = temp;
+            COUNT_SWAPS(1);
+            TRACE_SWAP(traced, i, j);
+        }
+    }
+
+    temp = arr[i + 1];
+    arr[i + 1] = arr[high];
+    arr[high] = temp;
+    COUNT_SWAPS(1);
+    TRACE_SWAP(traced, i + 1, high);
+
+    return (i + 1);
+}
+
+int partition(int arr[], int low, int high, int visualize) {
+    if (visualize) return partitionBody(arr, low, high, 1);
+    return partitionBody(arr, low, high, 0);
+}
+
+static void quickSortPlain(int arr[], int low, int high);
+static void quickSortTraced(int arr[], int low, int high);
+
+TRACEABLE void quickSortBody(int arr[], int low, int high, const int traced) {
+    if(low < high) {
+        int pi = partitionBody(arr, low, high, traced);
+
+        if (traced) {
+            quickSortTraced(arr, low, pi - 1);
+            quickSortTraced(arr, pi + 1, high);
+        } else {
+            quickSortPlain(arr, low, pi - 1);
+            quickSortPlain(arr, pi + 1, high);
+        }
+    }
+}
+
+static void quickSortPlain(int arr[], int low, int high) { quickSortBody(arr, low, high, 0); }
+static void quickSortTraced(int arr[], int low, int high) { quickSortBody(arr, low, high, 1); }
+
+void quickSort(int arr[], int low, int high, int visualize) {
+    if (visualize) quickSortTraced(arr, low, high);
+    else quickSortPlain(arr, low, high);
+}
+
+void printArray(int arr[], int n) {
+    for(int i = 0; i < n; i++) {
+        if(i % 10 == 0) printf("\n");
+        printf("[%3d] ", arr[i]);
+    }
+    printf("\n");
+}
+
+void copyArray(int source[], int dest[], int n) {
+    for(int i = 0; i < n; i++) {
+        dest[i] = source[i];
+    }
+}
+
+// Dijkstra three-way partition of arr[low..high] around pivot. On return
+// arr[low..lt-1] < pivot, arr[lt..gt] == pivot and arr[gt+1..high] > pivot.
+TRACEABLE void partition3WayBody(int arr[], int low, int high, int pivot, int *lt, int *gt,
+                                 const int traced) {
+    int l = low, i = low, g = high, temp;
+
+    while (i <= g) {
+        TRACE_COMPARE(traced, i, g);
+        COUNT_COMPARISONS(1);
+        if (arr[i] < pivot) {
+            temp = arr[l];
+            arr[l] = arr[i];
+            arr[i] = temp;
+            COUNT_SWAPS(1);
+            TRACE_SWAP(traced, l, i);
+            l++;
+            i++;
+        } else if (COUNT_COMPARISONS(1), arr[i] > pivot) {
+            temp = arr[g];
+            arr[g] = arr[i];
+            arr[i] = temp;
+            COUNT_SWAPS(1);
+            TRACE_SWAP(traced, g, i);
+            g--;
+        } else {
+            i++;
+        }
+    }
+    *lt = l;
+    *gt = g;
+}
+
+void partition3Way(int arr[], int low, int high, int pivot, int *lt, int *gt, int traced) {
+    if (traced) partition3WayBody(arr, low, high, pivot, lt, gt, 1);
+    else partition3WayBody(arr, low, high, pivot, lt, gt, 0);
+}
+
+TRACEABLE void insertionSortRangeBody(int arr[], int low, int high, const int traced) {
+    for (int i = low + 1; i <= high; i++) {
+        int key = arr[i];
+        int j = i - 1;
+        while (j >= low && (COUNT_COMPARISONS(1), TRACE_COMPARE(traced, j, i), arr[j] > key)) {
+            TRACE_WRITE(traced, arr, j + 1, arr[j]);
+            arr[j + 1] = arr[j];
+            COUNT_MOVES(1);
+            j--;
+        }
+        TRACE_WRITE(traced, arr, j + 1, key);
+        arr[j + 1] = key;
+    }
+}
+
+void insertionSortRange(int arr[], int low, int high) {
+    insertionSortRangeBody(arr, low, high, 0);
+}
+
+TRACEABLE void siftDown(int arr[], int base, int root, int count, const int traced) {
+    int temp;
+    while (2 * root + 1 < count) {
+        int child = 2 * root + 1;
+        if (child + 1 < count && (COUNT_COMPARISONS(1), arr[base + child] < arr[base + child + 1])) child++;
+        COUNT_COMPARISONS(1);
+        TRACE_COMPARE(traced, base + root, base + child);
+        if (arr[base + root] >= arr[base + child]) return;
+        temp = arr[base + root];
+        arr[base + root] = arr[base + child];
+        arr[base + child] = temp;
+        COUNT_SWAPS(1);
+        TRACE_SWAP(traced, base + root, base + child);
+        root = child;
+    }
+}
+
+TRACEABLE void heapSortRangeBody(int arr[], int low, int high, const int traced) {
+    int count = high - low + 1;
+    int temp;
+
+    for (int i = count / 2 - 1; i >= 0; i--) {
+        siftDown(arr, low, i, count, traced);
+    }
+    for (int end = count - 1; end > 0; end--) {
+        temp = arr[low];
+        arr[low] = arr[low + end];
+        arr[low + end] = temp;
+        COUNT_SWAPS(1);
+        TRACE_SWAP(traced, low, low + end);
+        siftDown(arr, low, 0, end, traced);
+    }
+}
+
+void heapSortRange(int arr[], int low, int high) {
+    heapSortRangeBody(arr, low, high, 0);
+}
+
+// Introsort: median-of-three/ninther pivots, three-way partitioning,
+// insertion sort for small ranges and a heapsort fallback once the
+// recursion depth exceeds 2*log2(n). Only the smaller side is recursed
+// into, so the stack stays O(log n) even on adversarial input.
+static void introSortLoopPlain(int arr[], int low, int high, int depth_limit);
+static void introSortLoopTraced(int arr[], int low, int high, int depth_limit);
+
+TRACEABLE void introSortLoopBody(int arr[], int low, int high, int depth_limit, const int traced) {
+    while (high - low + 1 > INSERTION_SORT_THRESHOLD) {
+        if (depth_limit == 0) {
+            heapSortRangeBody(arr, low, high, traced);
+            return;
+        }
+        depth_limit--;
+
+        int size = high - low + 1;
+        int mid = low + size / 2;
+        int pivot_idx;
+        if (size >= NINTHER_THRESHOLD) {
+            // Tukey's ninther: median of three medians-of-three
+            int step = size / 8;
+            int m1 = medianOfThree(arr, low, low + step, low + 2 * step);
+            int m2 = medianOfThree(arr, mid - step, mid, mid + step);
+            int m3 = medianOfThree(arr, high - 2 * step, high - step, high);
+            pivot_idx = medianOfThree(arr, m1, m2, m3);
+        } else {
+            pivot_idx = medianOfThree(arr, low, mid, high);
+        }
+
+        int lt, gt;
+        partition3WayBody(arr, low, high, arr[pivot_idx], &lt, &gt, traced);
+
+        // Recurse into the smaller side, loop on the larger one
+        if (lt - low < high - gt) {
+            if (traced) introSortLoopTraced(arr, low, lt - 1, depth_limit);
+            else introSortLoopPlain(arr, low, lt - 1, depth_limit);
+            low = gt + 1;
+        } else {
+            if (traced) introSortLoopTraced(arr, gt + 1, high, depth_limit);
+            else introSortLoopPlain(arr, gt + 1, high, depth_limit);
+            high = lt - 1;
+        }
+    }
+    insertionSortRangeBody(arr, low, high, traced);
+}
+
+static void introSortLoopPlain(int arr[], int low, int high, int depth_limit) {
+    introSortLoopBody(arr, low, high, depth_limit, 0);
+}
+
+static void introSortLoopTraced(int arr[], int low, int high, int depth_limit) {
+    introSortLoopBody(arr, low, high, depth_limit, 1);
+}
+
+void introSort(int arr[], int n, int visualize) {
+    int depth_limit = 0;
+    for (int m = n; m > 1; m >>= 1) depth_limit += 2;
+
+    if (visualize) introSortLoopTraced(arr, 0, n - 1, depth_limit);
+    else introSortLoopPlain(arr, 0, n - 1, depth_limit);
+}
+
+// Index of the median of arr[a], arr[b], arr[c]
+int medianOfThree(int arr[], int a, int b, int c) {
+    COUNT_COMPARISONS(3);
+    if (arr[a] < arr[b]) {
+        if (arr[b] < arr[c]) return b;
+        return arr[a] < arr[c] ? c : a;
+    }
+    if (arr[a] < arr[c]) return a;
+    return arr[b] < arr[c] ? c : b;
+}
+
+// Pattern-defeating quicksort (Orson Peters' pdqsort, branchless variant).
+// Partitioning fills blocks of offsets to misplaced elements with
+// unconditional stores and swaps them in cyclic permutations, so the
+// comparisons never feed a branch. Highly unbalanced partitions shuffle a
+// few elements to break up patterns and count towards a heapsort
+// fallback; a partition that needed no swaps is finished with a bounded
+// insertion sort, so sorted and reversed-then-sorted runs take O(n).
+static inline void pdqSwap(int arr[], ptrdiff_t a, ptrdiff_t b) {
+    int t = arr[a];
+    arr[a] = arr[b];
+    arr[b] = t;
+    COUNT_SWAPS(1);
+}
+
+static inline void pdqSort2(int arr[], ptrdiff_t a, ptrdiff_t b) {
+    COUNT_COMPARISONS(1);
+    if (arr[b] < arr[a]) pdqSwap(arr, a, b);
+}
+
+static inline void pdqSort3(int arr[], ptrdiff_t a, ptrdiff_t b, ptrdiff_t c) {
+    pdqSort2(arr, a, b);
+    pdqSort2(arr, b, c);
+    pdqSort2(arr, a, b);
+}
+
+// Guarded insertion sort for the leftmost range, which has no sentinel
+static void pdqInsertionSort(int arr[], ptrdiff_t begin, ptrdiff_t end) {
+    for (ptrdiff_t cur = begin + 1; cur < end; cur++) {
+        int tmp = arr[cur];
+        ptrdiff_t sift = cur;
+        while (sift > begin && (COUNT_COMPARISONS(1), tmp < arr[sift - 1])) {
+            arr[sift] = arr[sift - 1];
+            sift--;
+        }
+        arr[sift] = tmp;
+        COUNT_MOVES(cur - sift);
+    }
+}
+
+// Insertion sort of arr[begin..end) relying on arr[begin - 1] being no
+// larger than any element of the range, which stops every inner loop
+static void pdqUnguardedInsertionSort(int arr[], ptrdiff_t begin, ptrdiff_t end) {
+    for (ptrdiff_t cur = begin + 1; cur < end; cur++) {
+        int tmp = arr[cur];
+        ptrdiff_t sift = cur;
+        while (COUNT_COMPARISONS(1), tmp < arr[sift - 1]) {
+            arr[sift] = arr[sift - 1];
+            sift--;
+        }
+        arr[sift] = tmp;
+        COUNT_MOVES(cur - sift);
+    }
+}
+
+// Insertion sort that gives up after moving PDQ_PARTIAL_INSERTION_LIMIT
+// elements; returns whether arr[begin..end) ended up sorted
+static int pdqPartialInsertionSort(int arr[], ptrdiff_t begin, ptrdiff_t end) {
+    ptrdiff_t moved = 0;
+    for (ptrdiff_t cur = begin + 1; cur < end; cur++) {
+        int tmp = arr[cur];
+        ptrdiff_t sift = cur;
+        while (sift > begin && (COUNT_COMPARISONS(1), tmp < arr[sift - 1])) {
+            arr[sift] = arr[sift - 1];
+            sift--;
+        }
+        arr[sift] = tmp;
+        moved += cur - sift;
+        COUNT_MOVES(cur - sift);
+        if (moved > PDQ_PARTIAL_INSERTION_LIMIT) return 0;
+    }
+    return 1;
+}
+
+// Move num misplaced pairs given by the offset buffers. When both buffers
+// hold the same count, plain swaps keep the next block scan aligned;
+// otherwise the elements are rotated through one temporary.
+static inline void pdqSwapOffsets(int arr[], ptrdiff_t first, ptrdiff_t last, const unsigned char offsets_l[],
+                                  const unsigned char offsets_r[], int num, int use_swaps) {
+    if (use_swaps) {
+        for (int i = 0; i < num; i++) {
+            pdqSwap(arr, first + offsets_l[i], last - offsets_r[i]);
+        }
+    } else if (num > 0) {
+        ptrdiff_t l = first + offsets_l[0], r = last - offsets_r[0];
+        int tmp = arr[l];
+        arr[l] = arr[r];
+        for (int i = 1; i < num; i++) {
+            l = first + offsets_l[i];
+            arr[r] = arr[l];
+            r = last - offsets_r[i];
+            arr[l] = arr[r];
+        }
+        arr[r] = tmp;
+        COUNT_MOVES(2 * num + 1);
+    }
+}
+
+// Partition arr[begin..end) around the pivot arr[begin]: elements < pivot
+// go left, >= pivot right. Returns the pivot's final index and sets
+// *already_partitioned when no element had to move.
+static ptrdiff_t pdqPartitionRight(int arr[], ptrdiff_t begin, ptrdiff_t end, int *already_partitioned) {
+    int pivot = arr[begin];
+    ptrdiff_t first = begin, last = end;
+
+    // arr[end - 1] >= pivot after pivot selection, so this scan stops
+    while (COUNT_COMPARISONS(1), arr[++first] < pivot);
+    if (first - 1 == begin) {
+        while (first < last && (COUNT_COMPARISONS(1), !(arr[--last] < pivot)));
+    } else {
+        while (COUNT_COMPARISONS(1), !(arr[--last] < pivot));
+    }
+
+    *already_partitioned = first >= last;
+    if (!*already_partitioned) {
+        pdqSwap(arr, first, last);
+        first++;
+
+        unsigned char offsets_l[PDQ_BLOCK_SIZE] __attribute__((aligned(64)));
+        unsigned char offsets_r[PDQ_BLOCK_SIZE] __attribute__((aligned(64)));
+        int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+
+        // Both sides hold a full block of unknown elements
+        while (last - first > 2 * PDQ_BLOCK_SIZE) {
+            if (num_l == 0) {
+                start_l = 0;
+                for (int i = 0; i < PDQ_BLOCK_SIZE; i++) {
+                    offsets_l[num_l] = i;
+                    num_l += !(arr[first + i] < pivot);
+                }
+                COUNT_COMPARISONS(PDQ_BLOCK_SIZE);
+            }
+            if (num_r == 0) {
+                start_r = 0;
+                for (int i = 0; i < PDQ_BLOCK_SIZE; i++) {
+                    offsets_r[num_r] = i + 1;
+                    num_r += arr[last - i - 1] < pivot;
+                }
+                COUNT_COMPARISONS(PDQ_BLOCK_SIZE);
+            }
+
+            int num = num_l < num_r ? num_l : num_r;
+            pdqSwapOffsets(arr, first, last, offsets_l + start_l, offsets_r + start_r, num, num_l == num_r);
+            num_l -= num;
+            num_r -= num;
+            start_l += num;
+            start_r += num;
+            if (num_l == 0) first += PDQ_BLOCK_SIZE;
+            if (num_r == 0) last -= PDQ_BLOCK_SIZE;
+        }
+
+        // Split what is left between a final left and right block
+        int l_size, r_size;
+        int unknown_left = (int)(last - first) - ((num_r || num_l) ? PDQ_BLOCK_SIZE : 0);
+        if (num_r) {
+            l_size = unknown_left;
+            r_size = PDQ_BLOCK_SIZE;
+        } else if (num_l) {
+            l_size = PDQ_BLOCK_SIZE;
+            r_size = unknown_left;
+        } else {
+            l_size = unknown_left / 2;
+            r_size = unknown_left - l_size;
+        }
+
+        if (unknown_left && !num_l) {
+            start_l = 0;
+            for (int i = 0; i < l_size; i++) {
+                offsets_l[num_l] = i;
+                num_l += !(arr[first + i] < pivot);
+            }
+            COUNT_COMPARISONS(l_size);
+        }
+        if (unknown_left && !num_r) {
+            start_r = 0;
+            for (int i = 0; i < r_size; i++) {
+                offsets_r[num_r] = i + 1;
+                num_r += arr[last - i - 1] < pivot;
+            }
+            COUNT_COMPARISONS(r_size);
+        }
+
+        int num = num_l < num_r ? num_l : num_r;
+        pdqSwapOffsets(arr, first, last, offsets_l + start_l, offsets_r + start_r, num, num_l == num_r);
+        num_l -= num;
+        num_r -= num;
+        start_l += num;
+        start_r += num;
+        if (num_l == 0) first += l_size;
+        if (num_r == 0) last -= r_size;
+
+        // At most one side still has misplaced elements; move them past the other
+        if (num_l) {
+            while (num_l--) pdqSwap(arr, first + offsets_l[start_l + num_l], --last);
+            first = last;
+        }
+        if (num_r) {
+            while (num_r--) pdqSwap(arr, last - offsets_r[start_r + num_r], first++);
+            last = first;
+        }
+    }
+
+    ptrdiff_t pivot_pos = first - 1;
+    arr[begin] = arr[pivot_pos];
+    arr[pivot_pos] = pivot;
+    return pivot_pos;
+}
+
+// Partition arr[begin..end) so elements equal to the pivot arr[begin] go
+// left. Used when the pivot equals the element before the range, since
+// then no element of the range is smaller and the left side is all equal.
+static ptrdiff_t pdqPartitionLeft(int arr[], ptrdiff_t begin, ptrdiff_t end) {
+    int pivot = arr[begin];
+    ptrdiff_t first = begin, last = end;
+
+    while (COUNT_COMPARISONS(1), pivot < arr[--last]);
+    if (last + 1 == end) {
+        while (first < last && (COUNT_COMPARISONS(1), !(pivot < arr[++first])));
+    } else {
+        while (COUNT_COMPARISONS(1), !(pivot < arr[++first]));
+    }
+
+    while (first < last) {
+        pdqSwap(arr, first, last);
+        while (COUNT_COMPARISONS(1), pivot < arr[--last]);
+        while (COUNT_COMPARISONS(1), !(pivot < arr[++first]));
+    }
+
+    arr[begin] = arr[last];
+    arr[last] = pivot;
+    return last;
+}
+
+// Heapsort of arr[begin..end), the fallback after too many bad partitions
+static void pdqHeapSort(int arr[], ptrdiff_t begin, ptrdiff_t end) {
+    int *a = arr + begin;
+    ptrdiff_t n = end - begin;
+    for (ptrdiff_t start = n / 2 - 1, count = n; count > 1;) {
+        ptrdiff_t root;
+        if (start >= 0) {
+            root = start--;
+        } else {
+            pdqSwap(a, 0, --count);
+            root = 0;
+        }
+        int value = a[root];
+        for (ptrdiff_t child; (child = 2 * root + 1) < count; root = child) {
+            if (child + 1 < count && (COUNT_COMPARISONS(1), a[child] < a[child + 1])) child++;
+            COUNT_COMPARISONS(1);
+            if (a[child] <= value) break;
+            a[root] = a[child];
+        }
+        a[root] = value;
+    }
+}
+
+static void pdqSortLoop(int arr[], ptrdiff_t begin, ptrdiff_t end, int bad_allowed, int leftmost) {
+    while (1) {
+        ptrdiff_t size = end - begin;
+        if (size < PDQ_INSERTION_THRESHOLD) {
+            if (leftmost) pdqInsertionSort(arr, begin, end);
+            else pdqUnguardedInsertionSort(arr, begin, end);
+            return;
+        }
+
+        // Median of three, or Tukey's ninther, moved to arr[begin]
+        ptrdiff_t s2 = size / 2;
+        if (size > NINTHER_THRESHOLD) {
+            pdqSort3(arr, begin, begin + s2, end - 1);
+            pdqSort3(arr, begin + 1, begin + s2 - 1, end - 2);
+            pdqSort3(arr, begin + 2, begin + s2 + 1, end - 3);
+            pdqSort3(arr, begin + s2 - 1, begin + s2, begin + s2 + 1);
+            pdqSwap(arr, begin, begin + s2);
+        } else {
+            pdqSort3(arr, begin + s2, begin, end - 1);
+        }
+
+        // A pivot equal to the element before the range means the range
+        // starts with a run of equal keys: put them left and skip them
+        if (!leftmost && (COUNT_COMPARISONS(1), !(arr[begin - 1] < arr[begin]))) {
+            begin = pdqPartitionLeft(arr, begin, end) + 1;
+            continue;
+        }
+
+        int already_partitioned;
+        ptrdiff_t pivot_pos = pdqPartitionRight(arr, begin, end, &already_partitioned);
+        ptrdiff_t l_size = pivot_pos - begin;
+        ptrdiff_t r_size = end - (pivot_pos + 1);
+
+        if (l_size < size / 8 || r_size < size / 8) {
+            if (--bad_allowed == 0) {
+                pdqHeapSort(arr, begin, end);
+                return;
+            }
+            // Swap a few elements into new positions to break up the pattern
+            if (l_size >= PDQ_INSERTION_THRESHOLD) {
+                pdqSwap(arr, begin, begin + l_size / 4);
+                pdqSwap(arr, pivot_pos - 1, pivot_pos - l_size / 4);
+                if (l_size > NINTHER_THRESHOLD) {
+                    pdqSwap(arr, begin + 1, begin + l_size / 4 + 1);
+                    pdqSwap(arr, begin + 2, begin + l_size / 4 + 2);
+                    pdqSwap(arr, pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                    pdqSwap(arr, pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+                }
+            }
+            if (r_size >= PDQ_INSERTION_THRESHOLD) {
+                pdqSwap(arr, pivot_pos + 1, pivot_pos + 1 + r_size / 4);
+                pdqSwap(arr, end - 1, end - r_size / 4);
+                if (r_size > NINTHER_THRESHOLD) {
+                    pdqSwap(arr, pivot_pos + 2, pivot_pos + 2 + r_size / 4);
+                    pdqSwap(arr, pivot_pos + 3, pivot_pos + 3 + r_size / 4);
+                    pdqSwap(arr, end - 2, end - (1 + r_size / 4));
+                    pdqSwap(arr, end - 3, end - (2 + r_size / 4));
+                }
+            }
+        } else if (already_partitioned && pdqPartialInsertionSort(arr, begin, pivot_pos) &&
+                   pdqPartialInsertionSort(arr, pivot_pos + 1, end)) {
+            // Nothing moved and both sides were (nearly) sorted already
+            return;
+        }
+
+        pdqSortLoop(arr, begin, pivot_pos, bad_allowed, leftmost);
+        begin = pivot_pos + 1;
+        leftmost = 0;
+    }
+}
+
+// Indices are ptrdiff_t throughout, so pdqSortLarge handles arrays of
+// more than 2^31 elements
+void pdqSortLarge(int arr[], size_t n) {
+    int bad_allowed = 0;
+    for (size_t m = n; m > 1; m >>= 1) bad_allowed++;
+    if (n > 1) pdqSortLoop(arr, 0, (ptrdiff_t)n, bad_allowed, 1);
+}
+
+void pdqSort(int arr[], int n) {
+    if (n > 1) pdqSortLarge(arr, n);
+}
+
+// Bottom-up merge sort using a single n-sized scratch buffer. Blocks of
+// MERGE_RUN_SIZE are insertion sorted first, then each pass merges pairs of
+// runs from one buffer into the other, alternating direction so nothing is
+// copied back until the end. Pass scratch as NULL to have one allocated;
+// if that would exceed the scratch limit the in-place merge sort is used.
+void bottomUpMergeSort(int arr[], int n, int scratch[]) {
+    if (n < 2) return;
+
+    int *buffer = scratch;
+    if (buffer == NULL) {
+        if (!scratchFits(n * sizeof(int))) {
+            inPlaceMergeSort(arr, n);
+            return;
+        }
+        buffer = (int*)scratchAlloc(n * sizeof(int));
+    }
+
+    for (int low = 0; low < n; low += MERGE_RUN_SIZE) {
+        int high = low + MERGE_RUN_SIZE - 1;
+        insertionSortRange(arr, low, high < n ? high : n - 1);
+    }
+
+    int *src = arr, *dest = buffer, *swap;
+    for (int width = MERGE_RUN_SIZE; width < n; width *= 2) {
+        for (int left = 0; left < n; left += 2 * width) {
+            int mid = left + width - 1;
+            int right = left + 2 * width - 1;
+            if (mid >= n - 1) {
+                // Lone trailing run: carry it over to the destination
+                memcpy(dest + left, src + left, (n - left) * sizeof(int));
+                COUNT_MOVES(n - left);
+            } else {
+                if (right > n - 1) right = n - 1;
+                COUNT_COMPARISONS(1);
+                if (src[mid] <= src[mid + 1]) {
+                    // Halves already in order, skip the merge
+                    memcpy(dest + left, src + left, (right - left + 1) * sizeof(int));
+                    COUNT_MOVES(right - left + 1);
+                } else {
+                    mergeRuns(src, dest, left, mid, right);
+                }
+            }
+        }
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != arr) {
+        memcpy(arr, src, n * sizeof(int));
+        COUNT_MOVES(n);
+    }
+    if (scratch == NULL) {
+        scratchFree(buffer);
+    }
+}
+
+// Reverse arr[low..high)
+static void reverseRange(int arr[], int low, int high) {
+    COUNT_SWAPS((high - low) / 2);
+    for (high--; low < high; low++, high--) {
+        int t = arr[low];
+        arr[low] = arr[high];
+        arr[high] = t;
+    }
+}
+
+// Stable in-place merge of arr[a..m) and arr[m..b) by symmetric rotations
+// (SymMerge, Kim & Kutzner): O(n log n) moves, no scratch beyond the stack
+static void symMerge(int arr[], int a, int m, int b) {
+    if (m - a == 1) {
+        // Insert arr[a] before the first larger-or-equal element of the right run
+        int i = m, j = b, v = arr[a];
+        while (i < j) {
+            int h = i + (j - i) / 2;
+            COUNT_COMPARISONS(1);
+            if (arr[h] < v) i = h + 1;
+            else j = h;
+        }
+        memmove(arr + a, arr + a + 1, (i - 1 - a) * sizeof(int));
+        arr[i - 1] = v;
+        COUNT_MOVES(i - a);
+        return;
+    }
+    if (b - m == 1) {
+        // Insert arr[m] after the last smaller-or-equal element of the left run
+        int i = a, j = m, v = arr[m];
+        while (i < j) {
+            int h = i + (j - i) / 2;
+            COUNT_COMPARISONS(1);
+            if (v >= arr[h]) i = h + 1;
+            else j = h;
+        }
+        memmove(arr + i + 1, arr + i, (m - i) * sizeof(int));
+        arr[i] = v;
+        COUNT_MOVES(m - i + 1);
+        return;
+    }
+
+    int mid = a + (b - a) / 2;
+    int n = mid + m;
+    int start, r;
+    if (m > mid) {
+        start = n - b;
+        r = mid;
+    } else {
+        start = a;
+        r = m;
+    }
+    int p = n - 1;
+    while (start < r) {
+        int c = start + (r - start) / 2;
+        COUNT_COMPARISONS(1);
+        if (arr[p - c] >= arr[c]) start = c + 1;
+        else r = c;
+    }
+
+    int end = n - start;
+    if (start < m && m < end) {
+        // Rotate arr[start..end) so arr[m..end) comes first
+        reverseRange(arr, start, m);
+        reverseRange(arr, m, end);
+        reverseRange(arr, start, end);
+    }
+    if (a < start && start < mid) symMerge(arr, a, start, mid);
+    if (mid < end && end < b) symMerge(arr, mid, end, b);
+}
+
+// Stable merge sort without a scratch buffer, used in place of the
+// buffered merge sorts when the scratch limit (--max-scratch) is too small
+void inPlaceMergeSort(int arr[], int n) {
+    for (int low = 0; low < n; low += MERGE_RUN_SIZE) {
+        int high = low + MERGE_RUN_SIZE - 1;
+        insertionSortRange(arr, low, high < n ? high : n - 1);
+    }
+    for (int width = MERGE_RUN_SIZE; width < n; width *= 2) {
+        for (int left = 0; left + width < n; left += 2 * width) {
+            int right = left + 2 * width < n ? left + 2 * width : n;
+            COUNT_COMPARISONS(1);
+            if (arr[left + width - 1] > arr[left + width]) symMerge(arr, left, left + width, right);
+        }
+    }
+}
+
+// Stable merge of src[left..mid] and src[mid+1..right] into dest[left..right]
+void mergeRuns(int src[], int dest[], int left, int mid, int right) {
+    int i = left, j = mid + 1, k = left;
+
+    while (i <= mid && j <= right) {
+        COUNT_COMPARISONS(1);
+        if (src[i] <= src[j]) {
+            dest[k++] = src[i++];
+        } else {
+            dest[k++] = src[j++];
+        }
+    }
+    while (i <= mid) dest[k++] = src[i++];
+    while (j <= right) dest[k++] = src[j++];
+    COUNT_MOVES(right - left + 1);
+}
+
+// TimSort-style adaptive merge sort. The input is scanned for natural runs
+// (strictly descending ones are reversed in place); runs shorter than minrun
+// are extended with binary insertion. Runs are pushed on a stack and merged
+// while the stack invariant len[i-2] > len[i-1] + len[i] and
+// len[i-1] > len[i] is violated, which keeps merges balanced. Merges switch
+// to galloping (exponential search) once one side wins MIN_GALLOP times in
+// a row. Pass scratch as NULL to have n/2 elements allocated.
+typedef struct {
+    int *a;
+    int *tmp;          // Holds the shorter run of the merge in progress
+    int min_gallop;
+    int stack_size;
+    int run_base[TIMSORT_MAX_RUNS];
+    int run_len[TIMSORT_MAX_RUNS];
+} TimSortState;
+
+// minrun in [MIN_MERGE/2, MIN_MERGE] such that n/minrun is a power of two
+// or slightly less, so the final merges stay balanced
+static int timSortMinRun(int n) {
+    int r = 0;
+    while (n >= TIMSORT_MIN_MERGE) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// Length of the run starting at lo (hi exclusive), made ascending
+static int timSortCountRun(int a[], int lo, int hi) {
+    int run_hi = lo + 1;
+    if (run_hi == hi) return 1;
+
+    COUNT_COMPARISONS(1);
+    if (a[run_hi++] < a[lo]) {
+        while (run_hi < hi && (COUNT_COMPARISONS(1), a[run_hi] < a[run_hi - 1])) run_hi++;
+        // Strictly descending, so reversing keeps the sort stable
+        for (int i = lo, j = run_hi - 1; i < j; i++, j--) {
+            int temp = a[i];
+            a[i] = a[j];
+            a[j] = temp;
+            COUNT_SWAPS(1);
+        }
+    } else {
+        while (run_hi < hi && (COUNT_COMPARISONS(1), a[run_hi] >= a[run_hi - 1])) run_hi++;
+    }
+    return run_hi - lo;
+}
+
+// Sort a[lo..hi) given that a[lo..start) is already sorted
+static void binaryInsertionSort(int a[], int lo, int hi, int start) {
+    for (; start < hi; start++) {
+        int pivot = a[start];
+        int left = lo, right = start;
+        while (left < right) {
+            int mid = (left + right) >> 1;
+            COUNT_COMPARISONS(1);
+            if (pivot < a[mid]) right = mid;
+            else left = mid + 1;
+        }
+        memmove(&a[left + 1], &a[left], (start - left) * sizeof(int));
+        COUNT_MOVES(start - left + 1);
+        a[left] = pivot;
+    }
+}
+
+// Position of the first element of a[base..base+len) that is >= key,
+// searching exponentially outward from hint
+static int gallopLeft(int key, const int a[], int base, int len, int hint) {
+    int last_ofs = 0, ofs = 1;
+
+    COUNT_COMPARISONS(1);
+    if (key > a[base + hint]) {
+        int max_ofs = len - hint;
+        while (ofs < max_ofs && (COUNT_COMPARISONS(1), key > a[base + hint + ofs])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+            if (ofs <= 0) ofs = max_ofs;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        last_ofs += hint;
+        ofs += hint;
+    } else {
+        int max_ofs = hint + 1;
+        while (ofs < max_ofs && (COUNT_COMPARISONS(1), key <= a[base + hint - ofs])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+            if (ofs <= 0) ofs = max_ofs;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        int temp = last_ofs;
+        last_ofs = hint - ofs;
+        ofs = hint - temp;
+    }
+
+    // a[base+last_ofs] < key <= a[base+ofs]; finish with a binary search
+    last_ofs++;
+    while (last_ofs < ofs) {
+        int mid = last_ofs + ((ofs - last_ofs) >> 1);
+        COUNT_COMPARISONS(1);
+        if (key > a[base + mid]) last_ofs = mid + 1;
+        else ofs = mid;
+    }
+    return ofs;
+}
+
+// Like gallopLeft, but returns the position after any elements equal to key
+static int gallopRight(int key, const int a[], int base, int len, int hint) {
+    int last_ofs = 0, ofs = 1;
+
+    COUNT_COMPARISONS(1);
+    if (key < a[base + hint]) {
+        int max_ofs = hint + 1;
+        while (ofs < max_ofs && (COUNT_COMPARISONS(1), key < a[base + hint - ofs])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+            if (ofs <= 0) ofs = max_ofs;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        int temp = last_ofs;
+        last_ofs = hint - ofs;
+        ofs = hint - temp;
+    } else {
+        int max_ofs = len - hint;
+        while (ofs < max_ofs && (COUNT_COMPARISONS(1), key >= a[base + hint + ofs])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+            if (ofs <= 0) ofs = max_ofs;
+        }
+        if (ofs > max_ofs) ofs = max_ofs;
+        last_ofs += hint;
+        ofs += hint;
+    }
+
+    // a[base+last_ofs] <= key < a[base+ofs]
+    last_ofs++;
+    while (last_ofs < ofs) {
+        int mid = last_ofs + ((ofs - last_ofs) >> 1);
+        COUNT_COMPARISONS(1);
+        if (key < a[base + mid]) ofs = mid;
+        else last_ofs = mid + 1;
+    }
+    return ofs;
+}
+
+// Merge adjacent runs with len1 <= len2, copying the first run out and
+// filling from the left
+static void timSortMergeLo(TimSortState *s, int base1, int len1, int base2, int len2) {
+    int *a = s->a, *tmp = s->tmp;
+    memcpy(tmp, &a[base1], len1 * sizeof(int));
+    COUNT_MOVES(len1);
+
+    int cursor1 = 0, cursor2 = base2, dest = base1;
+    int min_gallop = s->min_gallop;
+
+    a[dest++] = a[cursor2++];
+    if (--len2 == 0) goto done;
+    if (len1 == 1) goto done;
+
+    for (;;) {
+        int count1 = 0, count2 = 0;
+
+        // One element at a time until one run wins min_gallop times in a row
+        do {
+            COUNT_COMPARISONS(1);
+            if (a[cursor2] < tmp[cursor1]) {
+                a[dest++] = a[cursor2++];
+                count2++;
+                count1 = 0;
+                if (--len2 == 0) goto done;
+            } else {
+                a[dest++] = tmp[cursor1++];
+                count1++;
+                count2 = 0;
+                if (--len1 == 1) goto done;
+            }
+        } while ((count1 | count2) < min_gallop);
+
+        // Gallop while either run keeps winning in long streaks
+        do {
+            count1 = gallopRight(a[cursor2], tmp, cursor1, len1, 0);
+            if (count1 != 0) {
+                memcpy(&a[dest], &tmp[cursor1], count1 * sizeof(int));
+                COUNT_MOVES(count1);
+                dest += count1;
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1) goto done;
+            }
+            a[dest++] = a[cursor2++];
+            if (--len2 == 0) goto done;
+
+            count2 = gallopLeft(tmp[cursor1], a, cursor2, len2, 0);
+            if (count2 != 0) {
+                memmove(&a[dest], &a[cursor2], count2 * sizeof(int));
+                COUNT_MOVES(count2);
+                dest += count2;
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0) goto done;
+            }
+            a[dest++] = tmp[cursor1++];
+            if (--len1 == 1) goto done;
+            min_gallop--;
+        } while (count1 >= TIMSORT_MIN_GALLOP || count2 >= TIMSORT_MIN_GALLOP);
+
+        // Leaving gallop mode costs more the sooner it happens
+        if (min_gallop < 0) min_gallop = 0;
+        min_gallop += 2;
+    }
+
+done:
+    s->min_gallop = min_gallop < 1 ? 1 : min_gallop;
+    if (len1 == 1) {
+        // The last element of run 1 goes after the rest of run 2
+        memmove(&a[dest], &a[cursor2], len2 * sizeof(int));
+        a[dest + len2] = tmp[cursor1];
+        COUNT_MOVES(len2 + 1);
+    } else if (len1 > 0) {
+        memcpy(&a[dest], &tmp[cursor1], len1 * sizeof(int));
+        COUNT_MOVES(len1);
+    }
+}
+
+// Merge adjacent runs with len1 >= len2, copying the second run out and
+// filling from the right
+static void timSortMergeHi(TimSortState *s, int base1, int len1, int base2, int len2) {
+    int *a = s->a, *tmp = s->tmp;
+    memcpy(tmp, &a[base2], len2 * sizeof(int));
+    COUNT_MOVES(len2);
+
+    int cursor1 = base1 + len1 - 1, cursor2 = len2 - 1, dest = base2 + len2 - 1;
+    int min_gallop = s->min_gallop;
+
+    a[dest--] = a[cursor1--];
+    if (--len1 == 0) goto done;
+    if (len2 == 1) goto done;
+
+    for (;;) {
+        int count1 = 0, count2 = 0;
+
+        do {
+            COUNT_COMPARISONS(1);
+            if (tmp[cursor2] < a[cursor1]) {
+                a[dest--] = a[cursor1--];
+                count1++;
+                count2 = 0;
+                if (--len1 == 0) goto done;
+            } else {
+                a[dest--] = tmp[cursor2--];
+                count2++;
+                count1 = 0;
+                if (--len2 == 1) goto done;
+            }
+        } while ((count1 | count2) < min_gallop);
+
+        do {
+            count1 = len1 - gallopRight(tmp[cursor2], a, base1, len1, len1 - 1);
+            if (count1 != 0) {
+                dest -= count1;
+                cursor1 -= count1;
+                len1 -= count1;
+                memmove(&a[dest + 1], &a[cursor1 + 1], count1 * sizeof(int));
+                COUNT_MOVES(count1);
+                if (len1 == 0) goto done;
+            }
+            a[dest--] = tmp[cursor2--];
+            if (--len2 == 1) goto done;
+
+            count2 = len2 - gallopLeft(a[cursor1], tmp, 0, len2, len2 - 1);
+            if (count2 != 0) {
+                dest -= count2;
+                cursor2 -= count2;
+                len2 -= count2;
+                memcpy(&a[dest + 1], &tmp[cursor2 + 1], count2 * sizeof(int));
+                COUNT_MOVES(count2);
+                if (len2 <= 1) goto done;
+            }
+            a[dest--] = a[cursor1--];
+            if (--len1 == 0) goto done;
+            min_gallop--;
+        } while (count1 >= TIMSORT_MIN_GALLOP || count2 >= TIMSORT_MIN_GALLOP);
+
+        if (min_gallop < 0) min_gallop = 0;
+        min_gallop += 2;
+    }
+
+done:
+    s->min_gallop = min_gallop < 1 ? 1 : min_gallop;
+    if (len2 == 1) {
+        // The first element of run 2 goes before the rest of run 1
+        dest -= len1;
+        cursor1 -= len1;
+        memmove(&a[dest + 1], &a[cursor1 + 1], len1 * sizeof(int));
+        a[dest] = tmp[cursor2];
+        COUNT_MOVES(len1 + 1);
+    } else if (len2 > 0) {
+        memcpy(&a[dest - (len2 - 1)], tmp, len2 * sizeof(int));
+        COUNT_MOVES(len2);
+    }
+}
+
+// Merge the runs at stack positions i and i + 1
+static void timSortMergeAt(TimSortState *s, int i) {
+    int *a = s->a;
+    int base1 = s->run_base[i], len1 = s->run_len[i];
+    int base2 = s->run_base[i + 1], len2 = s->run_len[i + 1];
+
+    s->run_len[i] = len1 + len2;
+    if (i == s->stack_size - 3) {
+        s->run_base[i + 1] = s->run_base[i + 2];
+        s->run_len[i + 1] = s->run_len[i + 2];
+    }
+    s->stack_size--;
+
+    // Elements of run 1 before run 2's first element, and of run 2 after
+    // run 1's last element, are already in place
+    int k = gallopRight(a[base2], a, base1, len1, 0);
+    base1 += k;
+    len1 -= k;
+    if (len1 == 0) return;
+    len2 = gallopLeft(a[base1 + len1 - 1], a, base2, len2, len2 - 1);
+    if (len2 == 0) return;
+
+    if (len1 <= len2) timSortMergeLo(s, base1, len1, base2, len2);
+    else timSortMergeHi(s, base1, len1, base2, len2);
+}
+
+// Restore the stack invariant, checking the top three entries so that a
+// violation deeper in the stack cannot go unnoticed
+static void timSortMergeCollapse(TimSortState *s) {
+    int *len = s->run_len;
+    while (s->stack_size > 1) {
+        int i = s->stack_size - 2;
+        if ((i > 0 && len[i - 1] <= len[i] + len[i + 1]) ||
+            (i > 1 && len[i - 2] <= len[i - 1] + len[i])) {
+            if (len[i - 1] < len[i + 1]) i--;
+        } else if (len[i] > len[i + 1]) {
+            break;
+        }
+        timSortMergeAt(s, i);
+    }
+}
+
+void timSort(int arr[], int n, int scratch[]) {
+    if (n < 2) return;
+
+    // Small arrays: one binary insertion sort past the leading run
+    if (n < TIMSORT_MIN_MERGE) {
+        binaryInsertionSort(arr, 0, n, timSortCountRun(arr, 0, n));
+        return;
+    }
+
+    TimSortState s;
+    s.a = arr;
+    s.tmp = scratch;
+    if (s.tmp == NULL) {
+        if (!scratchFits((n / 2 + 1) * sizeof(int))) {
+            inPlaceMergeSort(arr, n);
+            return;
+        }
+        s.tmp = (int*)scratchAlloc((n / 2 + 1) * sizeof(int));
+    }
+    s.min_gallop = TIMSORT_MIN_GALLOP;
+    s.stack_size = 0;
+
+    int min_run = timSortMinRun(n);
+    for (int lo = 0; lo < n;) {
+        int run = timSortCountRun(arr, lo, n);
+        if (run < min_run) {
+            int force = n - lo < min_run ? n - lo : min_run;
+            binaryInsertionSort(arr, lo, lo + force, lo + run);
+            run = force;
+        }
+
+        s.run_base[s.stack_size] = lo;
+        s.run_len[s.stack_size] = run;
+        s.stack_size++;
+        timSortMergeCollapse(&s);
+        lo += run;
+    }
+
+    while (s.stack_size > 1) {
+        int i = s.stack_size - 2;
+        if (i > 0 && s.run_len[i - 1] < s.run_len[i + 1]) i--;
+        timSortMergeAt(&s, i);
+    }
+
+    if (scratch == NULL) {
+        scratchFree(s.tmp);
+    }
+}
+
+// Selection: nth element, top-k and partial sort
+
+static void selectRange(int arr[], int low, int high, int k, int depth_limit);
+
+// Median-of-medians pivot for arr[low..high]. The median of each group of
+// five is moved to the front of the range and the median of those medians
+// is selected in place, which guarantees a 30/70 split or better.
+static int medianOfMedians(int arr[], int low, int high) {
+    int m = low, temp;
+
+    for (int i = low; i <= high; i += 5) {
+        int end = i + 4 <= high ? i + 4 : high;
+        insertionSortRange(arr, i, end);
+        int median = i + (end - i) / 2;
+        temp = arr[median];
+        arr[median] = arr[m];
+        arr[m] = temp;
+        COUNT_SWAPS(1);
+        m++;
+    }
+    if (m - low <= 1) return low;
+
+    int mid = low + (m - low - 1) / 2;
+    selectRange(arr, low, m - 1, mid, 0);
+    return mid;
+}
+
+// Introselect: quickselect with median-of-three pivots and three-way
+// partitioning, switching to median-of-medians pivots once depth_limit
+// partitions have been spent so the worst case stays O(n)
+static void selectRange(int arr[], int low, int high, int k, int depth_limit) {
+    while (high - low + 1 > INSERTION_SORT_THRESHOLD) {
+        int pivot_idx;
+        if (depth_limit > 0) {
+            depth_limit--;
+            pivot_idx = medianOfThree(arr, low, low + (high - low) / 2, high);
+        } else {
+            pivot_idx = medianOfMedians(arr, low, high);
+        }
+
+        int lt, gt;
+        partition3Way(arr, low, high, arr[pivot_idx], &lt, &gt, 0);
+        if (k < lt) high = lt - 1;
+        else if (k > gt) low = gt + 1;
+        else return;
+    }
+    insertionSortRange(arr, low, high);
+}
+
+// Rearrange arr so arr[k] is the value a full sort would put there, with
+// nothing larger before it and nothing smaller after it. Returns arr[k].
+int nthElement(int arr[], int n, int k) {
+    int depth_limit = 0;
+    for (int m = n; m > 1; m >>= 1) depth_limit += 2;
+
+    selectRange(arr, 0, n - 1, k, depth_limit);
+    return arr[k];
+}
+
+// The k smallest values of arr in ascending order, using a max-heap of k
+// elements so arr is read once and left untouched. Suited to k << n and
+// to input that arrives as a stream.
+void topK(const int arr[], int n, int k, int out[]) {
+    if (k > n) k = n;
+    if (k <= 0) return;
+
+    memcpy(out, arr, k * sizeof(int));
+    COUNT_MOVES(k);
+    for (int i = k / 2 - 1; i >= 0; i--) {
+        siftDown(out, 0, i, k, 0);
+    }
+    for (int i = k; i < n; i++) {
+        COUNT_COMPARISONS(1);
+        if (arr[i] < out[0]) {
+            out[0] = arr[i];
+            COUNT_MOVES(1);
+            siftDown(out, 0, 0, k, 0);
+        }
+    }
+
+    // Heapsort the survivors into ascending order
+    for (int end = k - 1; end > 0; end--) {
+        int temp = out[0];
+        out[0] = out[end];
+        out[end] = temp;
+        COUNT_SWAPS(1);
+        siftDown(out, 0, 0, end, 0);
+    }
+}
+
+// Sort only the k smallest values into arr[0..k); the rest of arr is left
+// in unspecified order
+void partialSort(int arr[], int n, int k) {
+    if (k > n) k = n;
+    if (k <= 0) return;
+
+    if (k < n) nthElement(arr, n, k - 1);
+    introSort(arr, k, 0);
+}
+
+// Work-stealing thread pool
+
+static void *poolWorkerMain(void *arg);
+
+void poolInit(int threads) {
+    if (pool.num_workers == threads) return;
+    poolShutdown();
+
+    pool.num_workers = threads;
+    pool.shutdown = 0;
+    atomic_store(&pool.active, 0);
+    pool.deques = (WorkDeque*)calloc(threads, sizeof(WorkDeque));
+    pool.threads = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    pthread_mutex_init(&pool.state_lock, NULL);
+    pthread_cond_init(&pool.state_cond, NULL);
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&pool.threads[i], NULL, poolWorkerMain, (void*)(intptr_t)i);
+    }
+}
+
+void poolShutdown() {
+    if (pool.num_workers == 0) return;
+
+    pthread_mutex_lock(&pool.state_lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.state_cond);
+    pthread_mutex_unlock(&pool.state_lock);
+    for (int i = 1; i < pool.num_workers; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    for (int i = 0; i < pool.num_workers; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool.state_lock);
+    pthread_cond_destroy(&pool.state_cond);
+    free(pool.deques);
+    free(pool.threads);
+    pool.num_workers = 0;
+}
+
+// Take the newest task from our own deque, otherwise steal the oldest
+// task from another worker
+static PoolTask *poolFindTask() {
+    WorkDeque *own = &pool.deques[worker_index];
+    PoolTask *task = NULL;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->count > 0) {
+        own->count--;
+        task = own->tasks[(own->head + own->count) % DEQUE_CAPACITY];
+    }
+    pthread_mutex_unlock(&own->lock);
+    if (task) return task;
+
+    for (int i = 1; i < pool.num_workers; i++) {
+        WorkDeque *victim = &pool.deques[(worker_index + i) % pool.num_workers];
+        if (victim->count == 0) continue;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count > 0) {
+            task = victim->tasks[victim->head];
+            victim->head = (victim->head + 1) % DEQUE_CAPACITY;
+            victim->count--;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+static void poolExecute(PoolTask *task) {
+    task->run(task->arg);
+    atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+static void *poolWorkerMain(void *arg) {
+    worker_index = (int)(intptr_t)arg;
+
+    for (;;) {
+        if (!atomic_load(&pool.active)) {
+            pthread_mutex_lock(&pool.state_lock);
+            while (!atomic_load(&pool.active) && !pool.shutdown) {
+                pthread_cond_wait(&pool.state_cond, &pool.state_lock);
+            }
+            int quit = pool.shutdown;
+            pthread_mutex_unlock(&pool.state_lock);
+            if (quit) return NULL;
+        }
+
+        PoolTask *task = poolFindTask();
+        if (task) poolExecute(task);
+        else sched_yield();
+    }
+}
+
+// Run a root task on the calling thread with the given number of workers
+void poolRun(void (*run)(void *arg), void *arg, int threads) {
+    poolInit(threads);
+    worker_index = 0;
+
+    pthread_mutex_lock(&pool.state_lock);
+    atomic_store(&pool.active, 1);
+    pthread_cond_broadcast(&pool.state_cond);
+    pthread_mutex_unlock(&pool.state_lock);
+
+    run(arg);
+
+    atomic_store(&pool.active, 0);
+}
+
+// Make a task available to other workers; runs it inline if the deque is full
+void poolSpawn(PoolTask *task, void (*run)(void *arg), void *arg) {
+    WorkDeque *own = &pool.deques[worker_index];
+
+    task->run = run;
+    task->arg = arg;
+    atomic_store(&task->done, 0);
+
+    pthread_mutex_lock(&own->lock);
+    if (own->count < DEQUE_CAPACITY) {
+        own->tasks[(own->head + own->count) % DEQUE_CAPACITY] = task;
+        own->count++;
+        task = NULL;
+    }
+    pthread_mutex_unlock(&own->lock);
+    if (task) poolExecute(task);
+}
+
+// Wait for a spawned task, running other tasks in the meantime
+void poolWait(PoolTask *task) {
+    while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+        PoolTask *other = poolFindTask();
+        if (other) poolExecute(other);
+        else sched_yield();
+    }
+}
+
+// Parallel merge sort
+
+typedef struct {
+    int *a, *b;     // Data and scratch buffers
+    int low, high;  // Half-open range [low, high)
+    int into_b;     // Leave the sorted range in b instead of a
+} MergeSortJob;
+
+typedef struct {
+    int *left, *right, *dest;
+    int n_left, n_right;
+} MergeJob;
+
+// First index in arr[0..n) whose value is >= key (or > key when upper)
+static int searchBound(int arr[], int n, int key, int upper) {
+    int low = 0, high = n;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (arr[mid] < key || (upper && arr[mid] == key)) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Stable merge of two sorted arrays into dest. Large merges split the
+// bigger input at its midpoint, binary search the split in the other one
+// and merge both halves in parallel.
+static void parallelMergeTask(void *arg) {
+    MergeJob *job = (MergeJob*)arg;
+    int split_left, split_right;
+
+    if (job->n_left + job->n_right <= PARALLEL_CUTOFF) {
+        int i = 0, j = 0, k = 0;
+        while (i < job->n_left && j < job->n_right) {
+            if (job->left[i] <= job->right[j]) job->dest[k++] = job->left[i++];
+            else job->dest[k++] = job->right[j++];
+        }
+        while (i < job->n_left) job->dest[k++] = job->left[i++];
+        while (j < job->n_right) job->dest[k++] = job->right[j++];
+        return;
+    }
+
+    if (job->n_left >= job->n_right) {
+        split_left = job->n_left / 2;
+        split_right = searchBound(job->right, job->n_right, job->left[split_left], 0);
+    } else {
+        split_right = job->n_right / 2;
+        split_left = searchBound(job->left, job->n_left, job->right[split_right], 1);
+    }
+
+    MergeJob first = {job->left, job->right, job->dest, split_left, split_right};
+    MergeJob second = {job->left + split_left, job->right + split_right,
+                       job->dest + split_left + split_right,
+                       job->n_left - split_left, job->n_right - split_right};
+    PoolTask task;
+    poolSpawn(&task, parallelMergeTask, &first);
+    parallelMergeTask(&second);
+    poolWait(&task);
+}
+
+static void parallelMergeSortTask(void *arg) {
+    MergeSortJob *job = (MergeSortJob*)arg;
+    int n = job->high - job->low;
+
+    if (n <= PARALLEL_CUTOFF) {
+        bottomUpMergeSort(job->a + job->low, n, job->b + job->low);
+        if (job->into_b) memcpy(job->b + job->low, job->a + job->low, n * sizeof(int));
+        return;
+    }
+
+    // Sort both halves into the opposite buffer, then merge them back
+    int mid = job->low + n / 2;
+    MergeSortJob left = {job->a, job->b, job->low, mid, !job->into_b};
+    MergeSortJob right = {job->a, job->b, mid, job->high, !job->into_b};
+    PoolTask task;
+    poolSpawn(&task, parallelMergeSortTask, &left);
+    parallelMergeSortTask(&right);
+    poolWait(&task);
+
+    int *src = job->into_b ? job->a : job->b;
+    int *dest = job->into_b ? job->b : job->a;
+    MergeJob merge_job = {src + job->low, src + mid, dest + job->low, mid - job->low, job->high - mid};
+    parallelMergeTask(&merge_job);
+}
+
+void parallelMergeSort(int arr[], int n, int threads) {
+    if (n < 2) return;
+
+    if (!scratchFits(n * sizeof(int))) {
+        inPlaceMergeSort(arr, n);
+        return;
+    }
+    int *scratch = (int*)scratchAlloc(n * sizeof(int));
+    MergeSortJob job = {arr, scratch, 0, n, 0};
+    poolRun(parallelMergeSortTask, &job, threads);
+    scratchFree(scratch);
+}
+
+// Parallel quick sort
+
+typedef struct {
+    int *arr, *scratch;
+    int low, high;      // Half-open range [low, high)
+    int depth_limit;
+} QuickSortJob;
+
+// One block of a parallel three-way partition
+typedef struct {
+    int *arr, *scratch;
+    int low, high;                      // Block range [low, high)
+    int pivot;
+    int less, equal;                    // Counts from the first phase
+    int less_at, equal_at, greater_at;  // Scatter offsets for the second phase
+    int phase;
+} PartitionBlock;
+
+static void partitionBlockTask(void *arg) {
+    PartitionBlock *block = (PartitionBlock*)arg;
+
+    if (block->phase == 0) {
+        block->less = block->equal = 0;
+        for (int i = block->low; i < block->high; i++) {
+            if (block->arr[i] < block->pivot) block->less++;
+            else if (block->arr[i] == block->pivot) block->equal++;
+        }
+    } else if (block->phase == 1) {
+        for (int i = block->low; i < block->high; i++) {
+            int value = block->arr[i];
+            if (value < block->pivot) block->scratch[block->less_at++] = value;
+            else if (value == block->pivot) block->scratch[block->equal_at++] = value;
+            else block->scratch[block->greater_at++] = value;
+        }
+    } else {
+        memcpy(block->arr + block->low, block->scratch + block->low,
+               (block->high - block->low) * sizeof(int));
+    }
+}
+
+// Count, scatter into scratch and copy back, each phase split into one
+// block per worker. Sets [*lt, *gt] to the range equal to pivot.
+static void parallelPartition(int arr[], int scratch[], int low, int high, int pivot, int *lt, int *gt) {
+    int blocks = pool.num_workers * 4;
+    int n = high - low;
+    PartitionBlock block[blocks];
+    PoolTask tasks[blocks];
+
+    for (int b = 0; b < blocks; b++) {
+        block[b].arr = arr;
+        block[b].scratch = scratch;
+        block[b].low = low + (int)((long)n * b / blocks);
+        block[b].high = low + (int)((long)n * (b + 1) / blocks);
+        block[b].pivot = pivot;
+    }
+
+    for (int phase = 0; phase < 3; phase++) {
+        if (phase == 1) {
+            int less_total = 0, equal_total = 0;
+            for (int b = 0; b < blocks; b++) {
+                less_total += block[b].less;
+                equal_total += block[b].equal;
+            }
+            int less_at = low, equal_at = low + less_total, greater_at = low + less_total + equal_total;
+            for (int b = 0; b < blocks; b++) {
+                int size = block[b].high - block[b].low;
+                block[b].less_at = less_at;
+                block[b].equal_at = equal_at;
+                block[b].greater_at = greater_at;
+                less_at += block[b].less;
+                equal_at += block[b].equal;
+                greater_at += size - block[b].less - block[b].equal;
+            }
+            *lt = low + less_total;
+            *gt = low + less_total + equal_total - 1;
+        }
+        for (int b = 0; b < blocks; b++) {
+            block[b].phase = phase;
+            poolSpawn(&tasks[b], partitionBlockTask, &block[b]);
+        }
+        for (int b = 0; b < blocks; b++) {
+            poolWait(&tasks[b]);
+        }
+    }
+}
+
+static void parallelQuickSortTask(void *arg) {
+    QuickSortJob *job = (QuickSortJob*)arg;
+    int n = job->high - job->low;
+
+    if (n <= PARALLEL_CUTOFF || job->depth_limit == 0) {
+        introSort(job->arr + job->low, n, 0);
+        return;
+    }
+
+    int *arr = job->arr;
+    int low = job->low, high = job->high - 1;
+    int mid = low + n / 2, step = n / 8;
+    int m1 = medianOfThree(arr, low, low + step, low + 2 * step);
+    int m2 = medianOfThree(arr, mid - step, mid, mid + step);
+    int m3 = medianOfThree(arr, high - 2 * step, high - step, high);
+    int pivot = arr[medianOfThree(arr, m1, m2, m3)];
+
+    int lt, gt;
+    if (job->scratch && n >= PARALLEL_PARTITION_MIN && pool.num_workers > 1) {
+        parallelPartition(arr, job->scratch, low, high + 1, pivot, &lt, &gt);
+    } else {
+        partition3Way(arr, low, high, pivot, &lt, &gt, 0);
+    }
+
+    QuickSortJob left = {arr, job->scratch, low, lt, job->depth_limit - 1};
+    QuickSortJob right = {arr, job->scratch, gt + 1, high + 1, job->depth_limit - 1};
+    PoolTask task;
+    poolSpawn(&task, parallelQuickSortTask, &left);
+    parallelQuickSortTask(&right);
+    poolWait(&task);
+}
+
+void parallelQuickSort(int arr[], int n, int threads) {
+    if (n < 2) return;
+
+    int depth_limit = 0;
+    for (int m = n; m > 1; m >>= 1) depth_limit += 2;
+
+    int *scratch = NULL;
+    if (n >= PARALLEL_PARTITION_MIN && threads > 1 && scratchFits(n * sizeof(int))) {
+        scratch = (int*)scratchAlloc(n * sizeof(int));
+    }
+    QuickSortJob job = {arr, scratch, 0, n, depth_limit};
+    poolRun(parallelQuickSortTask, &job, threads);
+    scratchFree(scratch);
+}
+
+// Counting sort for keys whose span (max - min) is at most
+// COUNTING_SORT_MAX_SPAN; wider inputs are handed to radix sort
+void countingSort(int arr[], int n) {
+    if (n < 2) return;
+
+    int min = arr[0], max = arr[0];
+    for (int i = 1; i < n; i++) {
+        if (arr[i] < min) min = arr[i];
+        if (arr[i] > max) max = arr[i];
+    }
+    if ((long)max - min > COUNTING_SORT_MAX_SPAN) {
+        radixSort(arr, n, 8, NULL);
+        return;
+    }
+
+    int span = max - min + 1;
+    if (!scratchFits(span * sizeof(int))) {
+        introSort(arr, n, 0);
+        return;
+    }
+    int *counts = (int*)scratchCalloc(span, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        counts[arr[i] - min]++;
+    }
+    int k = 0;
+    for (int v = 0; v < span; v++) {
+        for (int c = counts[v]; c > 0; c--) {
+            arr[k++] = v + min;
+        }
+    }
+    COUNT_MOVES(n);
+    scratchFree(counts);
+}
+
+// LSD radix sort over full 32-bit signed ints using digit_bits-wide digits
+// (8 or 11). The histograms for every pass are built in one read of the
+// input, passes where all elements share the same digit are skipped and
+// each pass ping-pongs between arr and scratch (allocated if NULL). When
+// the buffer would exceed the scratch limit, introsort is used instead.
+void radixSort(int arr[], int n, int digit_bits, int scratch[]) {
+    if (n < 2) return;
+
+    int radix = 1 << digit_bits;
+    int mask = radix - 1;
+    int passes = (32 + digit_bits - 1) / digit_bits;
+    if (scratch == NULL && !scratchFits((size_t)(n + passes * radix) * sizeof(int))) {
+        introSort(arr, n, 0);
+        return;
+    }
+    int *counts = (int*)scratchCalloc(passes * radix, sizeof(int));
+    int *buffer = scratch;
+    if (buffer == NULL) {
+        buffer = (int*)scratchAlloc(n * sizeof(int));
+    }
+
+    // Flipping the sign bit makes signed order match unsigned order
+    for (int i = 0; i < n; i++) {
+        unsigned key = (unsigned)arr[i] ^ 0x80000000u;
+        for (int p = 0; p < passes; p++) {
+            counts[p * radix + ((key >> (p * digit_bits)) & mask)]++;
+        }
+    }
+
+    int *src = arr, *dest = buffer, *swap;
+    for (int p = 0; p < passes; p++) {
+        int *count = counts + p * radix;
+        int shift = p * digit_bits;
+
+        if (count[((unsigned)src[0] ^ 0x80000000u) >> shift & mask] == n) continue;
+
+        // Turn counts into starting offsets
+        int offset = 0;
+        for (int d = 0; d < radix; d++) {
+            int c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            unsigned key = (unsigned)src[i] ^ 0x80000000u;
+            dest[count[(key >> shift) & mask]++] = src[i];
+        }
+        COUNT_MOVES(n);
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != arr) {
+        memcpy(arr, src, n * sizeof(int));
+    }
+    if (scratch == NULL) {
+        scratchFree(buffer);
+    }
+    scratchFree(counts);
+}
+
+// AVX2 sorting kernels
+
+#ifdef HAVE_AVX2_KERNELS
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Sort a bitonic vector of 8 ints
+AVX2_TARGET static inline __m256i bitonicClean8(__m256i v) {
+    __m256i p = _mm256_permute2x128_si256(v, v, 1);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xF0);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xCC);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xAA);
+}
+
+// Sort a bitonic sequence of count vectors (count a power of two)
+AVX2_TARGET static inline void bitonicSortVectors(__m256i v[], int count) {
+    for (int d = count / 2; d >= 1; d /= 2) {
+        for (int i = 0; i < count; i++) {
+            if (i & d) continue;
+            __m256i low = _mm256_min_epi32(v[i], v[i + d]);
+            v[i + d] = _mm256_max_epi32(v[i], v[i + d]);
+            v[i] = low;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        v[i] = bitonicClean8(v[i]);
+    }
+}
+
+// Bitonic merge of two sorted sequences of count <= 16 vectors each:
+// afterwards a[] holds the smallest 8*count values and b[] the largest,
+// both sorted
+AVX2_TARGET static inline void mergeVectors(__m256i a[], __m256i b[], int count) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i flipped[16];
+
+    for (int i = 0; i < count; i++) {
+        flipped[i] = _mm256_permutevar8x32_epi32(b[count - 1 - i], reverse);
+    }
+    for (int i = 0; i < count; i++) {
+        b[i] = _mm256_max_epi32(a[i], flipped[i]);
+        a[i] = _mm256_min_epi32(a[i], flipped[i]);
+    }
+    bitonicSortVectors(a, count);
+    bitonicSortVectors(b, count);
+}
+
+#define COMPARE_EXCHANGE(a, b) do { \
+    __m256i low_ = _mm256_min_epi32(a, b); \
+    b = _mm256_max_epi32(a, b); \
+    a = low_; \
+} while (0)
+
+// Sort 64 ints: an optimal 8-input network sorts the columns of an 8x8
+// block, a transpose turns them into sorted rows, and bitonic merges
+// combine the rows into runs of 16, 32 and finally 64
+AVX2_TARGET static void sortBlock64(int arr[]) {
+    __m256i r[8], t[8], u[8];
+
+    for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_si256((__m256i*)(arr + 8 * i));
+
+    COMPARE_EXCHANGE(r[0], r[2]); COMPARE_EXCHANGE(r[1], r[3]);
+    COMPARE_EXCHANGE(r[4], r[6]); COMPARE_EXCHANGE(r[5], r[7]);
+    COMPARE_EXCHANGE(r[0], r[4]); COMPARE_EXCHANGE(r[1], r[5]);
+    COMPARE_EXCHANGE(r[2], r[6]); COMPARE_EXCHANGE(r[3], r[7]);
+    COMPARE_EXCHANGE(r[0], r[1]); COMPARE_EXCHANGE(r[2], r[3]);
+    COMPARE_EXCHANGE(r[4], r[5]); COMPARE_EXCHANGE(r[6], r[7]);
+    COMPARE_EXCHANGE(r[2], r[4]); COMPARE_EXCHANGE(r[3], r[5]);
+    COMPARE_EXCHANGE(r[1], r[4]); COMPARE_EXCHANGE(r[3], r[6]);
+    COMPARE_EXCHANGE(r[1], r[2]); COMPARE_EXCHANGE(r[3], r[4]);
+    COMPARE_EXCHANGE(r[5], r[6]);
+
+    // 8x8 transpose
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+
+    for (int width = 1; width < 8; width *= 2) {
+        for (int i = 0; i < 8; i += 2 * width) {
+            mergeVectors(r + i, r + i + width, width);
+        }
+    }
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i*)(arr + 8 * i), r[i]);
+}
+
+// Merge sorted a[0..na) and b[0..nb) into dest, eight elements at a time.
+// The vector that was merged last holds the largest values seen so far;
+// the next vector is loaded from whichever input has the smaller head.
+AVX2_TARGET static void mergeAVX2(const int a[], int na, const int b[], int nb, int dest[]) {
+    int i = 0, j = 0, k = 0;
+    int pending[8], p = 8;
+
+    if (na >= 8 && nb >= 8) {
+        __m256i low = _mm256_loadu_si256((const __m256i*)a);
+        __m256i high = _mm256_loadu_si256((const __m256i*)b);
+        i = j = 8;
+        for (;;) {
+            mergeVectors(&low, &high, 1);
+            _mm256_storeu_si256((__m256i*)(dest + k), low);
+            k += 8;
+            if (i + 8 > na || j + 8 > nb) break;
+            if (a[i] <= b[j]) {
+                low = _mm256_loadu_si256((const __m256i*)(a + i));
+                i += 8;
+            } else {
+                low = _mm256_loadu_si256((const __m256i*)(b + j));
+                j += 8;
+            }
+        }
+        _mm256_storeu_si256((__m256i*)pending, high);
+        p = 0;
+    }
+
+    // Scalar three-way merge of the pending vector and both tails
+    while (p < 8 || i < na || j < nb) {
+        int best = INT_MAX, from = -1;
+        if (p < 8) { best = pending[p]; from = 0; }
+        if (i < na && (from < 0 || a[i] < best)) { best = a[i]; from = 1; }
+        if (j < nb && (from < 0 || b[j] < best)) { best = b[j]; from = 2; }
+        dest[k++] = best;
+        if (from == 0) p++;
+        else if (from == 1) i++;
+        else j++;
+    }
+}
+
+// Sort the 8 ints of one vector with the same 19-comparator network, one
+// permute/min/max/blend per layer
+AVX2_TARGET static inline __m256i sortVector8(__m256i v) {
+    static const int layers[6][8] = {
+        {2, 3, 0, 1, 6, 7, 4, 5}, {4, 5, 6, 7, 0, 1, 2, 3}, {1, 0, 3, 2, 5, 4, 7, 6},
+        {0, 1, 4, 5, 2, 3, 6, 7}, {0, 4, 2, 6, 1, 5, 3, 7}, {0, 2, 1, 4, 3, 6, 5, 7},
+    };
+    __m256i p, low, high;
+
+#define NETWORK_LAYER(l, mask) \
+    p = _mm256_permutevar8x32_epi32(v, _mm256_loadu_si256((const __m256i*)layers[l])); \
+    low = _mm256_min_epi32(v, p); \
+    high = _mm256_max_epi32(v, p); \
+    v = _mm256_blend_epi32(low, high, mask);
+
+    NETWORK_LAYER(0, 0xCC);
+    NETWORK_LAYER(1, 0xF0);
+    NETWORK_LAYER(2, 0xAA);
+    NETWORK_LAYER(3, 0x30);
+    NETWORK_LAYER(4, 0x50);
+    NETWORK_LAYER(5, 0x54);
+#undef NETWORK_LAYER
+    return v;
+}
+
+// Sort n <= SIMD_BLOCK_SIZE ints as a block of 8, 16, 32 or 64, padding
+// the unused tail with INT_MAX
+AVX2_TARGET static void sortSmallAVX2(int arr[], int n) {
+    int padded[SIMD_BLOCK_SIZE];
+    __m256i v[4];
+
+    if (n == SIMD_BLOCK_SIZE) {
+        sortBlock64(arr);
+        return;
+    }
+    int count = 1;
+    while (count * 8 < n) count *= 2;
+
+    memcpy(padded, arr, n * sizeof(int));
+    for (int i = n; i < count * 8; i++) padded[i] = INT_MAX;
+    if (count == 8) {
+        sortBlock64(padded);
+    } else {
+        for (int i = 0; i < count; i++) {
+            v[i] = sortVector8(_mm256_loadu_si256((__m256i*)(padded + 8 * i)));
+        }
+        for (int width = 1; width < count; width *= 2) {
+            for (int i = 0; i < count; i += 2 * width) {
+                mergeVectors(v + i, v + i + width, width);
+            }
+        }
+        for (int i = 0; i < count; i++) _mm256_storeu_si256((__m256i*)(padded + 8 * i), v[i]);
+    }
+    memcpy(arr, padded, n * sizeof(int));
+}
+
+// Sort SIMD_BLOCK_SIZE < n <= 4 * SIMD_BLOCK_SIZE ints as two or four
+// padded network blocks merged in registers, without a merge buffer
+AVX2_TARGET static void sortMediumAVX2(int arr[], int n) {
+    int padded[4 * SIMD_BLOCK_SIZE];
+    __m256i v[32];
+    int count = n <= 2 * SIMD_BLOCK_SIZE ? 16 : 32;
+
+    memcpy(padded, arr, n * sizeof(int));
+    for (int i = n; i < count * 8; i++) padded[i] = INT_MAX;
+    for (int i = 0; i < count * 8; i += SIMD_BLOCK_SIZE) sortBlock64(padded + i);
+    for (int i = 0; i < count; i++) v[i] = _mm256_loadu_si256((__m256i*)(padded + 8 * i));
+    for (int width = 8; width < count; width *= 2) {
+        for (int i = 0; i < count; i += 2 * width) {
+            mergeVectors(v + i, v + i + width, width);
+        }
+    }
+    for (int i = 0; i < count; i++) _mm256_storeu_si256((__m256i*)(padded + 8 * i), v[i]);
+    memcpy(arr, padded, n * sizeof(int));
+}
+#endif
+
+// Runtime CPU dispatch: nonzero when the AVX2 kernels can be used
+int simdAvailable() {
+#ifdef HAVE_AVX2_KERNELS
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return has_avx2;
+#else
+    return 0;
+#endif
+}
+
+// Sort up to SIMD_BLOCK_SIZE ints with the sorting network (padded with
+// INT_MAX to a full block), or with insertion sort without AVX2
+void simdSortSmall(int arr[], int n) {
+#ifdef HAVE_AVX2_KERNELS
+    if (simdAvailable()) {
+        sortSmallAVX2(arr, n);
+        return;
+    }
+#endif
+    insertionSortRange(arr, 0, n - 1);
+}
+
+// Bottom-up merge sort with sorting-network blocks and the vectorized
+// merge kernel; identical to bottomUpMergeSort when AVX2 is unavailable
+void simdMergeSort(int arr[], int n, int scratch[]) {
+#ifdef HAVE_AVX2_KERNELS
+    if (n < 2) return;
+    if (!simdAvailable()) {
+        bottomUpMergeSort(arr, n, scratch);
+        return;
+    }
+
+    int *buffer = scratch;
+    if (buffer == NULL) {
+        if (!scratchFits(n * sizeof(int))) {
+            inPlaceMergeSort(arr, n);
+            return;
+        }
+        buffer = (int*)scratchAlloc(n * sizeof(int));
+    }
+
+    for (int low = 0; low < n; low += SIMD_BLOCK_SIZE) {
+        sortSmallAVX2(arr + low, n - low < SIMD_BLOCK_SIZE ? n - low : SIMD_BLOCK_SIZE);
+    }
+
+    int *src = arr, *dest = buffer, *swap;
+    for (int width = SIMD_BLOCK_SIZE; width < n; width *= 2) {
+        for (int left = 0; left < n; left += 2 * width) {
+            int mid = left + width;
+            int right = left + 2 * width;
+            if (mid >= n) {
+                memcpy(dest + left, src + left, (n - left) * sizeof(int));
+            } else {
+                if (right > n) right = n;
+                if (src[mid - 1] <= src[mid]) {
+                    memcpy(dest + left, src + left, (right - left) * sizeof(int));
+                } else {
+                    mergeAVX2(src + left, mid - left, src + mid, right - mid, dest + left);
+                }
+            }
+        }
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != arr) {
+        memcpy(arr, src, n * sizeof(int));
+    }
+    if (scratch == NULL) {
+        scratchFree(buffer);
+    }
+#else
+    bottomUpMergeSort(arr, n, scratch);
+#endif
+}
+
+// Cache sizes
+
+// Parse a sysfs cache size such as "48K" or "32M" (also used for --cache)
+static size_t parseCacheSize(const char *text) {
+    char *end;
+    size_t size = strtoull(text, &end, 10);
+    if (*end == 'K' || *end == 'k') size <<= 10;
+    else if (*end == 'M' || *end == 'm') size <<= 20;
+    else if (*end == 'G' || *end == 'g') size <<= 30;
+    return size;
+}
+
+// Read the data cache sizes of CPU 0 from sysfs; levels that are not
+// reported keep their defaults
+void detectCacheSizes() {
+    for (int index = 0; index < 8; index++) {
+        char path[128], level[32] = "", type[32] = "", size[32] = "";
+        const char *fields[3] = {"level", "type", "size"};
+        char *values[3] = {level, type, size};
+        int ok = 1;
+
+        for (int f = 0; f < 3 && ok; f++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, fields[f]);
+            FILE *file = fopen(path, "r");
+            ok = file && fscanf(file, "%31s", values[f]) == 1;
+            if (file) fclose(file);
+        }
+        if (!ok) break;
+        if (strcmp(type, "Instruction") == 0) continue;
+
+        size_t bytes = parseCacheSize(size);
+        if (bytes == 0) continue;
+        if (atoi(level) == 1) cache_sizes.l1d = bytes;
+        else if (atoi(level) == 2) cache_sizes.l2 = bytes;
+        else cache_sizes.llc = bytes;
+    }
+}
+
+// Override with "L1,L2,LLC" sizes, e.g. 32K,1M,32M; empty fields are kept
+int parseCacheSizes(const char *list) {
+    size_t *levels[3] = {&cache_sizes.l1d, &cache_sizes.l2, &cache_sizes.llc};
+    const char *p = list;
+
+    for (int i = 0; i < 3 && *p; i++) {
+        if (*p != ',') {
+            size_t bytes = parseCacheSize(p);
+            if (bytes == 0) {
+                fprintf(stderr, "Invalid cache size in '%s'\n", list);
+                return 0;
+            }
+            *levels[i] = bytes;
+        }
+        p = strchr(p, ',');
+        if (!p) break;
+        p++;
+    }
+    return 1;
+}
+
+// Cache-aware multiway merge sort
+
+// Loser tree over the heads of k runs; exhausted runs hold LLONG_MAX
+static int mergeTreeBuild(int tree[], const long long keys[], int k, int node) {
+    if (node >= k) return node - k;
+    int left = mergeTreeBuild(tree, keys, k, 2 * node);
+    int right = mergeTreeBuild(tree, keys, k, 2 * node + 1);
+    if (keys[left] <= keys[right]) {
+        tree[node] = right;
+        return left;
+    }
+    tree[node] = left;
+    return right;
+}
+
+// Merge the k sorted runs src[bounds[i]..bounds[i + 1]) into dest at the
+// same offsets. With nontemporal set, output is staged in cache-line
+// sized pieces and written around the cache.
+static void multiwayMerge(const int src[], int dest[], const int bounds[], int k, int nontemporal) {
+    const int *cur[MULTIWAY_MAX_FANIN], *end[MULTIWAY_MAX_FANIN];
+    long long keys[MULTIWAY_MAX_FANIN];
+    int tree[MULTIWAY_MAX_FANIN];
+    long long tree_keys[MULTIWAY_MAX_FANIN];
+
+    for (int i = 0; i < k; i++) {
+        cur[i] = src + bounds[i];
+        end[i] = src + bounds[i + 1];
+        keys[i] = cur[i] < end[i] ? *cur[i] : LLONG_MAX;
+    }
+    tree[0] = k == 1 ? 0 : mergeTreeBuild(tree, keys, k, 1);
+    for (int node = 1; node < k; node++) {
+        tree_keys[node] = keys[tree[node]];
+    }
+
+    int *out = dest + bounds[0];
+    int total = bounds[k] - bounds[0];
+#ifdef HAVE_AVX2_KERNELS
+    int staged[16] __attribute__((aligned(64)));
+    int fill = 0;
+#endif
+    for (int produced = 0; produced < total; produced++) {
+        int winner = tree[0];
+        int value = (int)keys[winner];
+#ifdef HAVE_AVX2_KERNELS
+        if (nontemporal) {
+            staged[fill++] = value;
+            if (fill == 16) {
+                // Streaming stores need 16-byte aligned destinations
+                if (((uintptr_t)out & 15) == 0) {
+                    for (int q = 0; q < 4; q++) {
+                        _mm_stream_si128((__m128i*)out + q, _mm_load_si128((const __m128i*)staged + q));
+                    }
+                } else {
+                    memcpy(out, staged, sizeof(staged));
+                }
+                out += 16;
+                fill = 0;
+            }
+        } else {
+            *out++ = value;
+        }
+#else
+        (void)nontemporal;
+        *out++ = value;
+#endif
+
+        keys[winner] = ++cur[winner] < end[winner] ? *cur[winner] : LLONG_MAX;
+        // Each node keeps its loser's key, so replaying the matches needs no
+        // dependent loads and is decided with conditional moves
+        long long winner_key = keys[winner];
+        for (int node = (winner + k) / 2; node >= 1; node /= 2) {
+            long long other_key = tree_keys[node];
+            int other = tree[node];
+            int swap = other_key < winner_key;
+            tree[node] = swap ? winner : other;
+            tree_keys[node] = swap ? winner_key : other_key;
+            winner = swap ? other : winner;
+            winner_key = swap ? other_key : winner_key;
+            COUNT_COMPARISONS(1);
+        }
+        tree[0] = winner;
+    }
+#ifdef HAVE_AVX2_KERNELS
+    if (nontemporal) {
+        memcpy(out, staged, fill * sizeof(int));
+        _mm_sfence();
+    }
+#endif
+    COUNT_MOVES(total);
+}
+
+// Blocks small enough to be sorted within L2 are sorted in place by
+// pdqsort, then merged MULTIWAY fan-in at a time so the array crosses
+// memory about log_k(n / block) times instead of log2(n) times. The last
+// pass writes with non-temporal stores when the array exceeds the LLC.
+// Scratch (n ints) is allocated if NULL; when it does not fit the scratch
+// limit the whole array is sorted by pdqsort.
+void multiwayMergeSort(int arr[], int n, int scratch[]) {
+    if (n < 2) return;
+
+    // Half of L2 for the block, leaving room for the merge's output stream
+    int block = (int)(cache_sizes.l2 / 2 / sizeof(int)) & ~63;
+    if (block < MERGE_RUN_SIZE) block = MERGE_RUN_SIZE;
+    if (n <= block) {
+        pdqSort(arr, n);
+        return;
+    }
+
+    int *buffer = scratch;
+    if (buffer == NULL) {
+        if (!scratchFits(n * sizeof(int))) {
+            pdqSort(arr, n);
+            return;
+        }
+        buffer = (int*)scratchAlloc(n * sizeof(int));
+    }
+
+    // Fan-in keeps one cache line per input run resident in L1
+    int fanin = (int)(cache_sizes.l1d / 64 / 2);
+    if (fanin > MULTIWAY_MAX_FANIN) fanin = MULTIWAY_MAX_FANIN;
+    if (fanin < 2) fanin = 2;
+
+    int passes = 0;
+    for (long long width = block; width < n; width *= fanin) passes++;
+
+    // Sort the blocks where the passes will end in arr
+    int *src = passes % 2 ? buffer : arr;
+    int *dest = passes % 2 ? arr : buffer;
+    for (int low = 0; low < n; low += block) {
+        int count = n - low < block ? n - low : block;
+        if (src != arr) memcpy(src + low, arr + low, count * sizeof(int));
+        pdqSort(src + low, count);
+    }
+
+    int bounds[MULTIWAY_MAX_FANIN + 1];
+    int nontemporal = (size_t)n * sizeof(int) > cache_sizes.llc;
+    long long width = block;
+    for (int pass = 1; pass <= passes; pass++) {
+        for (long long left = 0; left < n; left += width * fanin) {
+            int k = 0;
+            for (long long low = left; low < n && k < fanin; low += width) {
+                bounds[k++] = (int)low;
+            }
+            bounds[k] = left + width * fanin < n ? (int)(left + width * fanin) : n;
+            multiwayMerge(src, dest, bounds, k, nontemporal && pass == passes);
+        }
+        int *swap = src;
+        src = dest;
+        dest = swap;
+        width *= fanin;
+    }
+
+    if (scratch == NULL) {
+        scratchFree(buffer);
+    }
+}
+
+// Input generators
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void prngSeed(Xoshiro256 *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&seed);
+    }
+}
+
+static inline uint64_t rotateLeft(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256** (Blackman and Vigna)
+uint64_t prngNext(Xoshiro256 *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
+    return result;
+}
+
+// Uniform value in [0, bound) by multiply-shift (Lemire)
+uint32_t prngBounded(Xoshiro256 *rng, uint32_t bound) {
+    return (uint32_t)(((prngNext(rng) >> 32) * (uint64_t)bound) >> 32);
+}
+
+// Uniform value in [0, bound) for bounds past 32 bits
+static uint64_t prngBounded64(Xoshiro256 *rng, uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)prngNext(rng) * bound) >> 64);
+}
+
+// Cumulative Zipf(s = 1) weights over ZIPF_KEYS ranks, built on first use
+static double *zipf_cdf = NULL;
+
+static void buildZipfTable() {
+    if (zipf_cdf) return;
+    zipf_cdf = (double*)malloc(ZIPF_KEYS * sizeof(double));
+    double total = 0;
+    for (int k = 0; k < ZIPF_KEYS; k++) {
+        total += 1.0 / (k + 1);
+        zipf_cdf[k] = total;
+    }
+    for (int k = 0; k < ZIPF_KEYS; k++) {
+        zipf_cdf[k] /= total;
+    }
+}
+
+// Value at index i of an evenly spaced ascending sequence over the int range
+static inline int sortedValue(size_t i, size_t n) {
+    return (int)(INT_MIN + (long long)((double)i * ((double)UINT32_MAX / n)));
+}
+
+typedef struct {
+    int *arr;
+    size_t n;
+    Distribution dist;
+    uint64_t seed;
+    size_t first_chunk, last_chunk;   // Chunk range [first_chunk, last_chunk)
+} GenerateJob;
+
+// Fill whole chunks. Every chunk draws from its own generator seeded from
+// (seed, chunk index), so the output does not depend on the thread count.
+static void generateChunks(void *arg) {
+    GenerateJob *job = (GenerateJob*)arg;
+
+    if (job->last_chunk - job->first_chunk > 1) {
+        size_t mid = job->first_chunk + (job->last_chunk - job->first_chunk) / 2;
+        GenerateJob left = *job, right = *job;
+        left.last_chunk = mid;
+        right.first_chunk = mid;
+        PoolTask task;
+        poolSpawn(&task, generateChunks, &left);
+        generateChunks(&right);
+        poolWait(&task);
+        return;
+    }
+
+    size_t n = job->n;
+    size_t low = job->first_chunk * GENERATOR_CHUNK;
+    size_t high = low + GENERATOR_CHUNK < n ? low + GENERATOR_CHUNK : n;
+    size_t run = (size_t)sqrt((double)n) + 1;
+    Xoshiro256 rng;
+    prngSeed(&rng, job->seed + (uint64_t)job->first_chunk * 0xD1B54A32D192ED03ull);
+
+    for (size_t i = low; i < high; i++) {
+        int value;
+        switch (job->dist) {
+            case DIST_SORTED:
+            case DIST_NEARLY_SORTED:
+                value = sortedValue(i, n);
+                break;
+            case DIST_REVERSED:
+                value = sortedValue(n - 1 - i, n);
+                break;
+            case DIST_FEW_UNIQUE:
+                value = (int)prngBounded(&rng, FEW_UNIQUE_VALUES);
+                break;
+            case DIST_ORGAN_PIPE:
+                value = (int)(i < n / 2 ? i : n - 1 - i);
+                break;
+            case DIST_SAWTOOTH:
+                value = (int)(i % run);
+                break;
+            case DIST_ZIPF: {
+                double u = (prngNext(&rng) >> 11) * 0x1.0p-53;
+                int lo = 0, hi = ZIPF_KEYS - 1;
+                while (lo < hi) {
+                    int mid = lo + (hi - lo) / 2;
+                    if (zipf_cdf[mid] < u) lo = mid + 1;
+                    else hi = mid;
+                }
+                value = lo + 1;
+                break;
+            }
+            default:
+                value = (int)(uint32_t)prngNext(&rng);
+                break;
+        }
+        job->arr[i] = value;
+    }
+}
+
+// Fill arr with n values of the given distribution. The same (n, dist,
+// seed) always yields the same array; large arrays are generated in
+// parallel chunks on the thread pool.
+void generateInput(int arr[], size_t n, Distribution dist, uint64_t seed) {
+    if (n == 0) return;
+    if (dist == DIST_ZIPF) buildZipfTable();
+
+    size_t chunks = (n + GENERATOR_CHUNK - 1) / GENERATOR_CHUNK;
+    GenerateJob job = {arr, n, dist, seed, 0, chunks};
+    if (n >= PARALLEL_GENERATE_MIN && num_threads > 1) {
+        poolRun(generateChunks, &job, num_threads);
+    } else {
+        for (size_t c = 0; c < chunks; c++) {
+            GenerateJob chunk = job;
+            chunk.first_chunk = c;
+            chunk.last_chunk = c + 1;
+            generateChunks(&chunk);
+        }
+    }
+
+    if (dist == DIST_NEARLY_SORTED) {
+        Xoshiro256 rng;
+        prngSeed(&rng, seed ^ 0x5DEECE66Dull);
+        // 32-bit draws below 2^32 elements keep existing seeds reproducible
+        for (size_t k = 0; k < n / 100; k++) {
+            size_t i = n <= UINT32_MAX ? prngBounded(&rng, (uint32_t)n) : prngBounded64(&rng, n);
+            size_t j = n <= UINT32_MAX ? prngBounded(&rng, (uint32_t)n) : prngBounded64(&rng, n);
+            int temp = arr[i];
+            arr[i] = arr[j];
+            arr[j] = temp;
+        }
+    }
+}
+
+// Index of the distribution with this command-line key, or -1
+int distributionFromKey(const char *key) {
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (strcmp(key, distribution_keys[d]) == 0) return d;
+    }
+    return -1;
+}
+
+// Lomuto quick sort recurses once per element on sorted and low-cardinality
+// inputs, which overflows the stack at large n
+int isImpracticalRun(int algorithm, Distribution dist, int n) {
+    return algorithms[algorithm].sort == runQuickSort && dist != DIST_UNIFORM &&
+           n > LOMUTO_MAX_PATTERN_SIZE;
+}
+
+// LSD radix sort for signed 64-bit keys with 8-bit digits, same scheme
+// as radixSort
+void radixSort64(long long arr[], int n, long long scratch[]) {
+    if (n < 2) return;
+
+    if (scratch == NULL && !scratchFits(n * sizeof(long long) + 8 * 256 * sizeof(int))) {
+        introSortInt64(arr, n);
+        return;
+    }
+    int (*counts)[256] = (int(*)[256])scratchCalloc(8 * 256, sizeof(int));
+    long long *buffer = scratch;
+    if (buffer == NULL) {
+        buffer = (long long*)scratchAlloc(n * sizeof(long long));
+    }
+
+    for (int i = 0; i < n; i++) {
+        unsigned long long key = (unsigned long long)arr[i] ^ 0x8000000000000000ull;
+        for (int p = 0; p < 8; p++) {
+            counts[p][(key >> (8 * p)) & 0xFF]++;
+        }
+    }
+
+    long long *src = arr, *dest = buffer, *swap;
+    for (int p = 0; p < 8; p++) {
+        int shift = 8 * p;
+        if (counts[p][(((unsigned long long)src[0] ^ 0x8000000000000000ull) >> shift) & 0xFF] == n) continue;
+
+        int offset = 0;
+        for (int d = 0; d < 256; d++) {
+            int c = counts[p][d];
+            counts[p][d] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            unsigned long long key = (unsigned long long)src[i] ^ 0x8000000000000000ull;
+            dest[counts[p][(key >> shift) & 0xFF]++] = src[i];
+        }
+        COUNT_MOVES(n);
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != arr) {
+        memcpy(arr, src, n * sizeof(long long));
+    }
+    if (scratch == NULL) {
+        scratchFree(buffer);
+    }
+    scratchFree(counts);
+}
+
+// Type-specialized sorts
+
+// Less-than for each element type. Floating-point NaNs compare greater
+// than every number and equal to each other, so they collect at the end.
+#define LESS_NUMERIC(a, b) ((a) < (b))
+#define LESS_FLOAT(a, b) (!isnan(a) && (isnan(b) || (a) < (b)))
+#define LESS_KEY(a, b) ((a).key < (b).key)
+
+// Indices into argsort_keys, ties broken by index so any sort is stable
+static const long long *argsort_keys;
+#define LESS_ARGSORT(a, b) \
+    (argsort_keys[a] < argsort_keys[b] || (argsort_keys[a] == argsort_keys[b] && (a) < (b)))
+
+#define DEFINE_TYPED_SORTS(SUFFIX, TYPE, LESS) \
+static void insertionSort##SUFFIX(TYPE arr[], int low, int high) { \
+    for (int i = low + 1; i <= high; i++) { \
+        TYPE key = arr[i]; \
+        int j = i - 1; \
+        while (j >= low && LESS(key, arr[j])) { \
+            arr[j + 1] = arr[j]; \
+            j--; \
+        } \
+        arr[j + 1] = key; \
+    } \
+} \
+\
+static void siftDown##SUFFIX(TYPE arr[], int root, int count) { \
+    while (2 * root + 1 < count) { \
+        int child = 2 * root + 1; \
+        if (child + 1 < count && LESS(arr[child], arr[child + 1])) child++; \
+        if (!LESS(arr[root], arr[child])) return; \
+        TYPE temp = arr[root]; \
+        arr[root] = arr[child]; \
+        arr[child] = temp; \
+        root = child; \
+    } \
+} \
+\
+static void heapSort##SUFFIX(TYPE arr[], int count) { \
+    for (int i = count / 2 - 1; i >= 0; i--) siftDown##SUFFIX(arr, i, count); \
+    for (int end = count - 1; end > 0; end--) { \
+        TYPE temp = arr[0]; \
+        arr[0] = arr[end]; \
+        arr[end] = temp; \
+        siftDown##SUFFIX(arr, 0, end); \
+    } \
+} \
+\
+/* Median-of-three Hoare partitioning; the smaller side is recursed into */ \
+static void introSortLoop##SUFFIX(TYPE arr[], int low, int high, int depth_limit) { \
+    TYPE temp; \
+    while (high - low + 1 > INSERTION_SORT_THRESHOLD) { \
+        if (depth_limit-- == 0) { \
+            heapSort##SUFFIX(arr + low, high - low + 1); \
+            return; \
+        } \
+        int mid = low + (high - low) / 2; \
+        if (LESS(arr[mid], arr[low])) { temp = arr[mid]; arr[mid] = arr[low]; arr[low] = temp; } \
+        if (LESS(arr[high], arr[mid])) { temp = arr[high]; arr[high] = arr[mid]; arr[mid] = temp; } \
+        if (LESS(arr[mid], arr[low])) { temp = arr[mid]; arr[mid] = arr[low]; arr[low] = temp; } \
+        TYPE pivot = arr[mid]; \
+        int i = low, j = high; \
+        while (i <= j) { \
+            while (LESS(arr[i], pivot)) i++; \
+            while (LESS(pivot, arr[j])) j--; \
+            if (i <= j) { \
+                temp = arr[i]; \
+                arr[i] = arr[j]; \
+                arr[j] = temp; \
+                i++; \
+                j--; \
+            } \
+        } \
+        if (j - low < high - i) { \
+            introSortLoop##SUFFIX(arr, low, j, depth_limit); \
+            low = i; \
+        } else { \
+            introSortLoop##SUFFIX(arr, i, high, depth_limit); \
+            high = j; \
+        } \
+    } \
+    insertionSort##SUFFIX(arr, low, high); \
+} \
+\
+void introSort##SUFFIX(TYPE arr[], int n) { \
+    int depth_limit = 0; \
+    for (int m = n; m > 1; m >>= 1) depth_limit += 2; \
+    introSortLoop##SUFFIX(arr, 0, n - 1, depth_limit); \
+} \
+\
+/* Reverse arr[low..high) */ \
+static void reverse##SUFFIX(TYPE arr[], int low, int high) { \
+    for (high--; low < high; low++, high--) { \
+        TYPE temp = arr[low]; \
+        arr[low] = arr[high]; \
+        arr[high] = temp; \
+    } \
+} \
+\
+/* SymMerge of arr[a..m) and arr[m..b), as symMerge() for int */ \
+static void symMerge##SUFFIX(TYPE arr[], int a, int m, int b) { \
+    if (m - a == 1) { \
+        int i = m, j = b; \
+        TYPE v = arr[a]; \
+        while (i < j) { \
+            int h = i + (j - i) / 2; \
+            if (LESS(arr[h], v)) i = h + 1; \
+            else j = h; \
+        } \
+        memmove(arr + a, arr + a + 1, (i - 1 - a) * sizeof(TYPE)); \
+        arr[i - 1] = v; \
+        return; \
+    } \
+    if (b - m == 1) { \
+        int i = a, j = m; \
+        TYPE v = arr[m]; \
+        while (i < j) { \
+            int h = i + (j - i) / 2; \
+            if (!LESS(v, arr[h])) i = h + 1; \
+            else j = h; \
+        } \
+        memmove(arr + i + 1, arr + i, (m - i) * sizeof(TYPE)); \
+        arr[i] = v; \
+        return; \
+    } \
+    int mid = a + (b - a) / 2, n = mid + m; \
+    int start = m > mid ? n - b : a, r = m > mid ? mid : m, p = n - 1; \
+    while (start < r) { \
+        int c = start + (r - start) / 2; \
+        if (!LESS(arr[p - c], arr[c])) start = c + 1; \
+        else r = c; \
+    } \
+    int end = n - start; \
+    if (start < m && m < end) { \
+        reverse##SUFFIX(arr, start, m); \
+        reverse##SUFFIX(arr, m, end); \
+        reverse##SUFFIX(arr, start, end); \
+    } \
+    if (a < start && start < mid) symMerge##SUFFIX(arr, a, start, mid); \
+    if (mid < end && end < b) symMerge##SUFFIX(arr, mid, end, b); \
+} \
+\
+/* Stable: on ties the element from the left run is taken first. Without \
+   scratch (--max-scratch) the runs are merged in place. */ \
+void stableSort##SUFFIX(TYPE arr[], int n, TYPE scratch[]) { \
+    if (n < 2) return; \
+    TYPE *buffer = scratch; \
+    if (!buffer && scratchFits(n * sizeof(TYPE))) buffer = (TYPE*)scratchAlloc(n * sizeof(TYPE)); \
+    for (int low = 0; low < n; low += MERGE_RUN_SIZE) { \
+        int high = low + MERGE_RUN_SIZE - 1; \
+        insertionSort##SUFFIX(arr, low, high < n ? high : n - 1); \
+    } \
+    if (!buffer) { \
+        for (int width = MERGE_RUN_SIZE; width < n; width *= 2) { \
+            for (int left = 0; left + width < n; left += 2 * width) { \
+                int right = left + 2 * width < n ? left + 2 * width : n; \
+                if (LESS(arr[left + width], arr[left + width - 1])) { \
+                    symMerge##SUFFIX(arr, left, left + width, right); \
+                } \
+            } \
+        } \
+        return; \
+    } \
+    TYPE *src = arr, *dest = buffer, *swap; \
+    for (int width = MERGE_RUN_SIZE; width < n; width *= 2) { \
+        for (int left = 0; left < n; left += 2 * width) { \
+            int mid = left + width < n ? left + width : n; \
+            int right = left + 2 * width < n ? left + 2 * width : n; \
+            int i = left, j = mid, k = left; \
+            while (i < mid && j < right) { \
+                if (LESS(src[j], src[i])) dest[k++] = src[j++]; \
+                else dest[k++] = src[i++]; \
+            } \
+            while (i < mid) dest[k++] = src[i++]; \
+            while (j < right) dest[k++] = src[j++]; \
+        } \
+        swap = src; \
+        src = dest; \
+        dest = swap; \
+    } \
+    if (src != arr) memcpy(arr, src, n * sizeof(TYPE)); \
+    if (!scratch) scratchFree(buffer); \
+}
+
+DEFINE_TYPED_SORTS(Int64, long long, LESS_NUMERIC)
+DEFINE_TYPED_SORTS(UInt32, unsigned int, LESS_NUMERIC)
+DEFINE_TYPED_SORTS(Float, float, LESS_FLOAT)
+DEFINE_TYPED_SORTS(Double, double, LESS_FLOAT)
+DEFINE_TYPED_SORTS(Record, KeyPayload, LESS_KEY)
+DEFINE_TYPED_SORTS(KeyIndex, KeyIndex, LESS_KEY)
+DEFINE_TYPED_SORTS(ArgIndex, int, LESS_ARGSORT)
+
+// Stable argsort: index[i] receives the position of the i-th smallest key.
+// Without scratch for the key/index pairs, the indices are sorted in place
+// with the keys looked up through argsort_keys.
+void argsortInt64(const long long keys[], int index[], int n) {
+    if (n <= 0) return;
+    KeyIndex *pairs = scratchFits(n * sizeof(KeyIndex)) ? (KeyIndex*)scratchAlloc(n * sizeof(KeyIndex)) : NULL;
+    if (!pairs) {
+        for (int i = 0; i < n; i++) index[i] = i;
+        argsort_keys = keys;
+        introSortArgIndex(index, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        pairs[i].key = keys[i];
+        pairs[i].index = i;
+    }
+    stableSortKeyIndex(pairs, n, NULL);
+    for (int i = 0; i < n; i++) {
+        index[i] = pairs[i].index;
+    }
+    scratchFree(pairs);
+}
+
+// qsort() comparators for the generic callback baseline
+static int compareInt64(const void *a, const void *b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareUInt32(const void *a, const void *b) {
+    unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareFloat(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return LESS_FLOAT(y, x) - LESS_FLOAT(x, y);
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return LESS_FLOAT(y, x) - LESS_FLOAT(x, y);
+}
+
+static int compareRecord(const void *a, const void *b) {
+    return compareInt64(&((const KeyPayload*)a)->key, &((const KeyPayload*)b)->key);
+}
+
+static int compareArgsortIndex(const void *a, const void *b) {
+    return compareInt64(&argsort_keys[*(const int*)a], &argsort_keys[*(const int*)b]);
+}
+
+// Whether work holds the n elements of a typed benchmark in order, NaNs
+// last. With stable set, equal keys must also keep their input order: the
+// payloads of records and the indices of argsort rise within a key.
+static int typedSortCorrect(int type, const char *work, const long long keys[], int n, int stable) {
+    for (int i = 1; i < n; i++) {
+        switch (type) {
+            case TYPED_INT64:
+                if (((const long long*)work)[i] < ((const long long*)work)[i - 1]) return 0;
+                break;
+            case TYPED_UINT32:
+                if (((const unsigned*)work)[i] < ((const unsigned*)work)[i - 1]) return 0;
+                break;
+            case TYPED_FLOAT:
+                if (LESS_FLOAT(((const float*)work)[i], ((const float*)work)[i - 1])) return 0;
+                break;
+            case TYPED_DOUBLE:
+                if (LESS_FLOAT(((const double*)work)[i], ((const double*)work)[i - 1])) return 0;
+                break;
+            case TYPED_RECORD: {
+                const KeyPayload *a = (const KeyPayload*)work + i - 1, *b = a + 1;
+                if (b->key < a->key || (stable && b->key == a->key && b->payload < a->payload)) return 0;
+                break;
+            }
+            case TYPED_ARGSORT: {
+                int a = ((const int*)work)[i - 1], b = ((const int*)work)[i];
+                if (a < 0 || a >= n || b < 0 || b >= n) return 0;
+                if (keys[b] < keys[a] || (stable && keys[b] == keys[a] && b < a)) return 0;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+// Time qsort(), the specialized introsort and the specialized stable merge
+// sort on the same n random elements of the given type. Argsort compares
+// qsort over indices with argsortInt64 (stable) in both specialized slots.
+// Returns 2 if any of them produced a wrong order.
+int timeTypedSorts(int type, int n, double *qsort_time, double *intro_time, double *stable_time) {
+    static const size_t sizes[NUM_TYPED_BENCHMARKS] = {
+        sizeof(long long), sizeof(unsigned), sizeof(float), sizeof(double), sizeof(KeyPayload), sizeof(int)
+    };
+    size_t size = sizes[type];
+    char *input = (char*)malloc((size_t)n * size);
+    char *work = (char*)malloc((size_t)n * size);
+    long long *keys = (long long*)malloc(n * sizeof(long long));
+    Xoshiro256 rng;
+    double start;
+    int status = 0;
+
+    prngSeed(&rng, input_seed);
+    for (int i = 0; i < n; i++) {
+        uint64_t bits = prngNext(&rng);
+        keys[i] = (long long)bits;
+        switch (type) {
+            case TYPED_INT64: ((long long*)input)[i] = (long long)bits; break;
+            case TYPED_UINT32: ((unsigned*)input)[i] = (unsigned)bits; break;
+            case TYPED_FLOAT: ((float*)input)[i] = (float)((long long)bits * 0x1.0p-40); break;
+            case TYPED_DOUBLE:
+                // About 1% NaNs
+                ((double*)input)[i] = bits % 100 == 0 ? NAN : (long long)bits * 0x1.0p-40;
+                break;
+            case TYPED_RECORD:
+                // Few distinct keys so stability is visible in the payloads
+                ((KeyPayload*)input)[i].key = (long long)(bits % 1000);
+                ((KeyPayload*)input)[i].payload = i;
+                break;
+            case TYPED_ARGSORT: ((int*)input)[i] = i; break;
+        }
+    }
+
+    static int (*const comparators[NUM_TYPED_BENCHMARKS])(const void*, const void*) = {
+        compareInt64, compareUInt32, compareFloat, compareDouble, compareRecord, compareArgsortIndex
+    };
+    argsort_keys = keys;
+    memcpy(work, input, (size_t)n * size);
+    start = nowSeconds();
+    qsort(work, n, size, comparators[type]);
+    *qsort_time = nowSeconds() - start;
+    if (!typedSortCorrect(type, work, keys, n, 0)) {
+        fprintf(stderr, "qsort produced unsorted %s output at n=%d\n", typed_benchmark_names[type], n);
+        status = 2;
+    }
+
+    for (int stable = 0; stable < 2; stable++) {
+        memcpy(work, input, (size_t)n * size);
+        start = nowSeconds();
+        switch (type) {
+            case TYPED_INT64:
+                if (stable) stableSortInt64((long long*)work, n, NULL);
+                else introSortInt64((long long*)work, n);
+                break;
+            case TYPED_UINT32:
+                if (stable) stableSortUInt32((unsigned*)work, n, NULL);
+                else introSortUInt32((unsigned*)work, n);
+                break;
+            case TYPED_FLOAT:
+                if (stable) stableSortFloat((float*)work, n, NULL);
+                else introSortFloat((float*)work, n);
+                break;
+            case TYPED_DOUBLE:
+                if (stable) stableSortDouble((double*)work, n, NULL);
+                else introSortDouble((double*)work, n);
+                break;
+            case TYPED_RECORD:
+                if (stable) stableSortRecord((KeyPayload*)work, n, NULL);
+                else introSortRecord((KeyPayload*)work, n);
+                break;
+            case TYPED_ARGSORT:
+                argsortInt64(keys, (int*)work, n);
+                break;
+        }
+        *(stable ? stable_time : intro_time) = nowSeconds() - start;
+        if (!typedSortCorrect(type, work, keys, n, stable || type == TYPED_ARGSORT)) {
+            fprintf(stderr, "%s produced unsorted %s output at n=%d\n",
+                    type == TYPED_ARGSORT ? "argsortInt64" : stable ? "Stable merge" : "Introsort",
+                    typed_benchmark_names[type], n);
+            status = 2;
+        }
+    }
+
+    free(input);
+    free(work);
+    free(keys);
+    return status;
+}
+
+// String sorting
+
+// Load the 8 bytes of s starting at depth, big-endian so that integer
+// order is byte order. Bytes past the terminator are zero, so a key whose
+// last byte is zero belongs to a string that ends inside it.
+static inline uint64_t stringKey(const unsigned char *s, int depth) {
+    uint64_t key = 0;
+    int i = 0;
+    s += depth;
+    for (; i < 8 && s[i]; i++) key = key << 8 | s[i];
+    return i ? key << (8 * (8 - i)) : 0;
+}
+
+static inline void refillKeys(StringRef a[], int n, int depth) {
+    for (int i = 0; i < n; i++) a[i].key = stringKey(a[i].str, depth);
+}
+
+// Order of two strings whose first depth bytes are equal and whose keys
+// were loaded at depth
+static inline int compareStringRefs(const StringRef *x, const StringRef *y, int depth) {
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if ((x->key & 0xFF) == 0) return 0;
+    return strcmp((const char*)x->str + depth + 8, (const char*)y->str + depth + 8);
+}
+
+static void stringInsertionSort(StringRef a[], int n, int depth) {
+    for (int i = 1; i < n; i++) {
+        StringRef item = a[i];
+        int j = i - 1;
+        while (j >= 0 && compareStringRefs(&a[j], &item, depth) > 0) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = item;
+    }
+}
+
+static inline void swapStringRefs(StringRef a[], int i, int j) {
+    StringRef t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+}
+
+// Multikey quicksort (Bentley & Sedgewick) on 8-byte keys: partition three
+// ways on the cached key, recurse on the smaller and larger sides at the
+// same depth and continue with the equal side 8 bytes deeper
+static void multikeyQuickSortLoop(StringRef a[], int n, int depth) {
+    while (n > STRING_INSERTION_THRESHOLD) {
+        uint64_t k0 = a[0].key, k1 = a[n / 2].key, k2 = a[n - 1].key;
+        uint64_t pivot = k0 < k1 ? (k1 < k2 ? k1 : (k0 < k2 ? k2 : k0))
+                                 : (k0 < k2 ? k0 : (k1 < k2 ? k2 : k1));
+
+        int lt = 0, i = 0, gt = n - 1;
+        while (i <= gt) {
+            if (a[i].key < pivot) swapStringRefs(a, lt++, i++);
+            else if (a[i].key > pivot) swapStringRefs(a, i, gt--);
+            else i++;
+        }
+
+        multikeyQuickSortLoop(a, lt, depth);
+        multikeyQuickSortLoop(a + gt + 1, n - gt - 1, depth);
+
+        // Equal keys that end in a zero byte are equal strings
+        a += lt;
+        n = gt - lt + 1;
+        if ((pivot & 0xFF) == 0) return;
+        depth += 8;
+        refillKeys(a, n, depth);
+    }
+    stringInsertionSort(a, n, depth);
+}
+
+void multikeyQuickSort(StringRef a[], int n) {
+    refillKeys(a, n, 0);
+    multikeyQuickSortLoop(a, n, 0);
+}
+
+// MSD radix sort one byte at a time. Digits come from the cached key, which
+// is reloaded for a bucket every 8 levels; buckets smaller than
+// MSD_INSERTION_THRESHOLD are insertion sorted. Levels where every string
+// has the same byte, as in long shared prefixes, are skipped without moving.
+static void msdRadixSortLoop(StringRef a[], StringRef tmp[], int n, int depth) {
+    int shift, counts[256];
+    while (1) {
+        if (n < MSD_INSERTION_THRESHOLD) {
+            stringInsertionSort(a, n, depth & ~7);
+            return;
+        }
+
+        shift = 56 - 8 * (depth & 7);
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < n; i++) counts[(a[i].key >> shift) & 0xFF]++;
+
+        int digit = (a[0].key >> shift) & 0xFF;
+        if (counts[digit] < n) break;
+        if (digit == 0) return;
+        if ((depth & 7) == 7) refillKeys(a, n, depth + 1);
+        depth++;
+    }
+
+    int offsets[256], sum = 0;
+    for (int c = 0; c < 256; c++) {
+        offsets[c] = sum;
+        sum += counts[c];
+    }
+    for (int i = 0; i < n; i++) tmp[offsets[(a[i].key >> shift) & 0xFF]++] = a[i];
+    memcpy(a, tmp, n * sizeof(StringRef));
+
+    // Bucket 0 holds strings that ended: all equal
+    for (int c = 1, start = counts[0]; c < 256; start += counts[c], c++) {
+        if (counts[c] < 2) continue;
+        if ((depth & 7) == 7) refillKeys(a + start, counts[c], depth + 1);
+        msdRadixSortLoop(a + start, tmp, counts[c], depth + 1);
+    }
+}
+
+void msdRadixSortStrings(StringRef a[], int n) {
+    refillKeys(a, n, 0);
+    StringRef *tmp = (StringRef*)scratchAlloc(n * sizeof(StringRef));
+    msdRadixSortLoop(a, tmp, n, 0);
+    scratchFree(tmp);
+}
+
+// Baseline: top-down merge sort of string pointers compared with strcmp
+static void mergeSortStringsLoop(const char *a[], const char *tmp[], int n) {
+    if (n < 2) return;
+    int mid = n / 2;
+    mergeSortStringsLoop(a, tmp, mid);
+    mergeSortStringsLoop(a + mid, tmp, n - mid);
+
+    memcpy(tmp, a, mid * sizeof(char*));
+    int i = 0, j = mid, k = 0;
+    while (i < mid && j < n) {
+        if (strcmp(a[j], tmp[i]) < 0) a[k++] = a[j++];
+        else a[k++] = tmp[i++];
+    }
+    while (i < mid) a[k++] = tmp[i++];
+}
+
+void mergeSortStrings(const char *a[], int n) {
+    const char **tmp = (const char**)scratchAlloc((n / 2 + 1) * sizeof(char*));
+    mergeSortStringsLoop(a, tmp, n);
+    scratchFree(tmp);
+}
+
+// Read newline-separated strings into one arena; newlines become
+// terminators. Returns the arena, or NULL on error.
+static char *readStringFile(const char *path, size_t *bytes, const char ***lines, int *count) {
+    int fd = path && strcmp(path, "-") != 0 ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+
+    size_t capacity = 1 << 20, size = 0;
+    char *arena = (char*)malloc(capacity + 1);
+    ssize_t got;
+    while (arena && (got = read(fd, arena + size, capacity - size)) > 0) {
+        size += got;
+        if (size == capacity) {
+            capacity *= 2;
+            char *grown = (char*)realloc(arena, capacity + 1);
+            if (!grown) free(arena);
+            arena = grown;
+        }
+    }
+    if (fd != STDIN_FILENO) close(fd);
+    if (!arena) {
+        fprintf(stderr, "Out of memory reading strings\n");
+        return NULL;
+    }
+    if (size > 0 && arena[size - 1] != '\n') arena[size++] = '\n';
+
+    int n = 0;
+    for (size_t i = 0; i < size; i++) n += arena[i] == '\n';
+    *lines = (const char**)malloc((n > 0 ? n : 1) * sizeof(char*));
+    n = 0;
+    for (size_t start = 0, i = 0; i < size; i++) {
+        if (arena[i] != '\n') continue;
+        arena[i] = '\0';
+        (*lines)[n++] = arena + start;
+        start = i + 1;
+    }
+    *bytes = size;
+    *count = n;
+    return arena;
+}
+
+static size_t commonPrefix(const char *a, const char *b) {
+    size_t i = 0;
+    while (a[i] && a[i] == b[i]) i++;
+    return i;
+}
+
+// Sort newline-separated strings (--strings) with multikey quicksort and
+// MSD radix sort against a strcmp merge sort, and report the
+// distinguishing prefix: the bytes any comparison-free sort must inspect
+int runStringBenchmark(const char *path, const char *output_path, BenchConfig *config) {
+    size_t bytes;
+    const char **lines;
+    int n;
+    char *arena = readStringFile(path, &bytes, &lines, &n);
+    if (!arena) return 1;
+
+    const char **sorted = (const char**)malloc((n > 0 ? n : 1) * sizeof(char*));
+    StringRef *refs = (StringRef*)malloc((n > 0 ? n : 1) * sizeof(StringRef));
+    double *samples = (double*)malloc(config->reps * sizeof(double));
+    const char *method_names[] = {"Merge (strcmp)", "Multikey quick", "MSD radix"};
+    int status = 0;
+
+    printf("+-----------------+--------------+--------------+--------------+------------+\n");
+    printf("| Method          | Min (s)      | Median (s)   | P95 (s)      | MB/s       |\n");
+    printf("+-----------------+--------------+--------------+--------------+------------+\n");
+    for (int method = 0; method < 3; method++) {
+        for (int r = 0; r < config->warmup + config->reps; r++) {
+            if (method == 0) memcpy(sorted, lines, n * sizeof(char*));
+            for (int i = 0; method > 0 && i < n; i++) refs[i].str = (const unsigned char*)lines[i];
+            scratchReset(n * sizeof(StringRef));
+
+            double start = nowSeconds();
+            if (method == 0) mergeSortStrings(sorted, n);
+            else if (method == 1) multikeyQuickSort(refs, n);
+            else msdRadixSortStrings(refs, n);
+            double seconds = nowSeconds() - start;
+            if (r >= config->warmup) samples[r - config->warmup] = seconds;
+        }
+
+        // The radix sorts must agree with the strcmp baseline
+        for (int i = 0; method > 0 && i < n; i++) {
+            if (strcmp((const char*)refs[i].str, sorted[i]) != 0) {
+                fprintf(stderr, "%s produced a different order at line %d\n", method_names[method], i);
+                status = 2;
+                break;
+            }
+        }
+
+        BenchStats stats;
+        computeBenchStats(samples, config->reps, n, &stats);
+        printf("| %-15s | %12.6f | %12.6f | %12.6f | %10.1f |\n", method_names[method], stats.min,
+               stats.median, stats.p95, stats.min > 0 ? bytes / 1e6 / stats.min : 0);
+        fflush(stdout);
+    }
+    printf("+-----------------+--------------+--------------+--------------+------------+\n");
+
+    // A string's distinguishing prefix reaches one byte past its longest
+    // common prefix with a neighbor in sorted order, or its whole length
+    unsigned long long distinguishing = 0;
+    size_t previous_lcp = 0;
+    for (int i = 0; i < n; i++) {
+        size_t next_lcp = i + 1 < n ? commonPrefix(sorted[i], sorted[i + 1]) : 0;
+        size_t lcp = previous_lcp > next_lcp ? previous_lcp : next_lcp;
+        size_t length = strlen(sorted[i]);
+        distinguishing += lcp + 1 < length ? lcp + 1 : length;
+        previous_lcp = next_lcp;
+    }
+    printf("%d strings, %.1f MB, average length %.1f; distinguishing prefix %llu bytes "
+           "(%.1f%% of input, %.1f per string)\n", n, bytes / 1e6, n ? (double)(bytes - n) / n : 0,
+           distinguishing, bytes > (size_t)n ? 100.0 * distinguishing / (bytes - n) : 0,
+           n ? (double)distinguishing / n : 0);
+
+    if (output_path) {
+        FILE *out = fopen(output_path, "w");
+        if (!out) {
+            perror(output_path);
+            status = 1;
+        } else {
+            for (int i = 0; i < n; i++) {
+                fputs(sorted[i], out);
+                fputc('\n', out);
+            }
+            fclose(out);
+        }
+    }
+
+    free(samples);
+    free(refs);
+    free(sorted);
+    free(lines);
+    free(arena);
+    return status;
+}
+
+// Large arrays
+
+// Map bytes rounded up to whole 2 MB pages on a 2 MB boundary. Reserved
+// hugetlbfs pages are tried first, then transparent huge pages through
+// madvise; *page_kind says which was granted ("4k" if neither).
+void *largeAlloc(size_t bytes, const char **page_kind) {
+    size_t length = (bytes + LARGE_PAGE_SIZE - 1) & ~(size_t)(LARGE_PAGE_SIZE - 1);
+    void *block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (block != MAP_FAILED) {
+        *page_kind = "hugetlb";
+        return block;
+    }
+
+    // Over-map by one huge page and trim both ends to the boundary
+    char *raw = (char*)mmap(NULL, length + LARGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char *aligned = (char*)(((uintptr_t)raw + LARGE_PAGE_SIZE - 1) & ~(uintptr_t)(LARGE_PAGE_SIZE - 1));
+    if (aligned > raw) munmap(raw, aligned - raw);
+    munmap(aligned + length, raw + LARGE_PAGE_SIZE - aligned);
+    *page_kind = madvise(aligned, length, MADV_HUGEPAGE) == 0 ? "thp" : "4k";
+    return aligned;
+}
+
+void largeFree(void *block, size_t bytes) {
+    if (block) munmap(block, (bytes + LARGE_PAGE_SIZE - 1) & ~(size_t)(LARGE_PAGE_SIZE - 1));
+}
+
+// Anonymous memory currently backed by transparent huge pages, or -1
+static long anonHugePagesKB() {
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    if (!file) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(file);
+    return kb;
+}
+
+// One phase of the large-array kernels over parts [first_part, last_part).
+// Part p always covers the same slice of the array, so the thread that
+// first touches a slice is one of those that later works on it, and the
+// kernel places its pages on that thread's NUMA node.
+typedef enum { LARGE_TOUCH, LARGE_HISTOGRAM, LARGE_SCATTER, LARGE_COPY } LargePhase;
+
+typedef struct {
+    LargePhase phase;
+    int *src, *dest;
+    size_t n;
+    int parts, first_part, last_part;
+    int shift;
+    size_t (*counts)[1 << LARGE_RADIX_BITS];   // Per-part digit counts, then offsets
+} LargeJob;
+
+static void largeTask(void *arg) {
+    LargeJob *job = (LargeJob*)arg;
+
+    if (job->last_part - job->first_part > 1) {
+        int mid = job->first_part + (job->last_part - job->first_part) / 2;
+        LargeJob left = *job, right = *job;
+        left.last_part = mid;
+        right.first_part = mid;
+        PoolTask task;
+        poolSpawn(&task, largeTask, &left);
+        largeTask(&right);
+        poolWait(&task);
+        return;
+    }
+
+    int p = job->first_part;
+    size_t low = job->n * p / job->parts;
+    size_t high = job->n * (p + 1) / job->parts;
+    unsigned mask = (1u << LARGE_RADIX_BITS) - 1;
+
+    switch (job->phase) {
+        case LARGE_TOUCH:
+            memset(job->src + low, 0, (high - low) * sizeof(int));
+            if (job->dest) memset(job->dest + low, 0, (high - low) * sizeof(int));
+            break;
+        case LARGE_HISTOGRAM: {
+            size_t *count = job->counts[p];
+            memset(count, 0, sizeof(job->counts[0]));
+            for (size_t i = low; i < high; i++) {
+                count[(((unsigned)job->src[i] ^ 0x80000000u) >> job->shift) & mask]++;
+            }
+            break;
+        }
+        case LARGE_SCATTER: {
+            size_t *offset = job->counts[p];
+            for (size_t i = low; i < high; i++) {
+                unsigned key = (unsigned)job->src[i] ^ 0x80000000u;
+                job->dest[offset[(key >> job->shift) & mask]++] = job->src[i];
+            }
+            break;
+        }
+        case LARGE_COPY:
+            memcpy(job->dest + low, job->src + low, (high - low) * sizeof(int));
+            break;
+    }
+}
+
+static void largeRun(LargeJob *job, LargePhase phase) {
+    job->phase = phase;
+    job->first_part = 0;
+    job->last_part = job->parts;
+    if (job->parts > 1) poolRun(largeTask, job, num_threads);
+    else largeTask(job);
+}
+
+// Slices per array: a few per thread so work stealing can even them out
+static int largeParts(size_t n) {
+    int parts = num_threads > 1 ? num_threads * 4 : 1;
+    if (parts > LARGE_MAX_PARTS) parts = LARGE_MAX_PARTS;
+    if ((size_t)parts > n) parts = n > 0 ? (int)n : 1;
+    return parts;
+}
+
+// Zero a and b (which may be NULL) slice by slice on the thread pool
+void largeFirstTouch(int a[], int b[], size_t n) {
+    LargeJob job = {LARGE_TOUCH, a, b, n, largeParts(n), 0, 0, 0, NULL};
+    largeRun(&job, LARGE_TOUCH);
+}
+
+// Parallel LSD radix sort of n ints with LARGE_RADIX_BITS-wide digits and
+// size_t offsets. Every part histograms its slice, the offsets are laid
+// out part by part within each digit so the sort stays stable, and every
+// part scatters its slice; passes where all elements share one digit are
+// skipped. scratch holds n ints.
+void largeRadixSort(int arr[], size_t n, int scratch[]) {
+    if (n < 2) return;
+
+    LargeJob job = {LARGE_HISTOGRAM, arr, scratch, n, largeParts(n), 0, 0, 0, NULL};
+    job.counts = (size_t (*)[1 << LARGE_RADIX_BITS])malloc(job.parts * sizeof(job.counts[0]));
+
+    for (int shift = 0; shift < 32; shift += LARGE_RADIX_BITS) {
+        job.shift = shift;
+        largeRun(&job, LARGE_HISTOGRAM);
+
+        size_t offset = 0;
+        int skip = 0;
+        for (int d = 0; d < 1 << LARGE_RADIX_BITS && !skip; d++) {
+            size_t start = offset;
+            for (int p = 0; p < job.parts; p++) {
+                size_t c = job.counts[p][d];
+                job.counts[p][d] = offset;
+                offset += c;
+            }
+            skip = offset - start == n;
+        }
+        if (skip) continue;
+
+        largeRun(&job, LARGE_SCATTER);
+        COUNT_MOVES(n);
+        int *swap = job.src;
+        job.src = job.dest;
+        job.dest = swap;
+    }
+
+    if (job.src != arr) {
+        job.dest = arr;
+        largeRun(&job, LARGE_COPY);
+    }
+    free(job.counts);
+}
+
+// Large-array benchmark (--large): generate n elements of every selected
+// distribution into huge-page buffers and sort them once with each
+// selected 64-bit kernel (pdq, radix). Page faults are counted for the
+// whole process by getrusage and for the calling thread by perf, along
+// with its dTLB load misses.
+int runLargeBenchmark(size_t n, BenchConfig *config) {
+    int use_pdq = 0, use_radix = 0;
+    for (int a = 0; a < num_algorithms; a++) {
+        if (!config->selected[a]) continue;
+        if (strcmp(algorithms[a].key, "pdq") == 0) use_pdq = 1;
+        else if (strcmp(algorithms[a].key, "radix") == 0) use_radix = 1;
+    }
+    if (!use_pdq && !use_radix) {
+        fprintf(stderr, "--large supports the pdq and radix algorithms\n");
+        return 1;
+    }
+
+    size_t bytes = n * sizeof(int);
+    const char *data_pages, *scratch_pages = "-";
+    int *data = (int*)largeAlloc(bytes, &data_pages);
+    int *scratch = use_radix ? (int*)largeAlloc(bytes, &scratch_pages) : NULL;
+    if (!data || (use_radix && !scratch)) {
+        fprintf(stderr, "Cannot map %.1f GB for %zu elements\n", (use_radix ? 2.0 : 1.0) * bytes / 1e9, n);
+        largeFree(data, bytes);
+        largeFree(scratch, bytes);
+        return 1;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long minor_before = usage.ru_minflt;
+    long huge_before = anonHugePagesKB();
+    double start = nowSeconds();
+    largeFirstTouch(data, scratch, n);
+    double touch_seconds = nowSeconds() - start;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%zu elements (%.2f GB per buffer), %d threads; data pages: %s, scratch pages: %s\n",
+           n, bytes / 1e9, num_threads, data_pages, scratch_pages);
+    printf("First touch: %.3f s, %ld minor faults", touch_seconds, usage.ru_minflt - minor_before);
+    long huge_kb = anonHugePagesKB();
+    if (huge_before >= 0 && huge_kb >= huge_before) {
+        double share = 100.0 * (huge_kb - huge_before) * 1024 / ((use_radix ? 2.0 : 1.0) * bytes);
+        printf(", %.1f%% on transparent huge pages", share < 100 ? share : 100);
+    }
+    printf("\n");
+    if (!perfAvailable()) printf("Hardware counters unavailable; dTLB misses are not reported\n");
+
+    printf("+-----------+-----------+--------------+--------------+--------------+------------+------------+\n");
+    printf("| Algorithm | Input     | Time (s)     | Elements/s   | dTLB misses  | Minor flt  | Major flt  |\n");
+    printf("+-----------+-----------+--------------+--------------+--------------+------------+------------+\n");
+
+    int status = 0;
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (!config->distributions[d]) continue;
+
+        for (int k = 0; k < 2; k++) {
+            if (!(k == 0 ? use_pdq : use_radix)) continue;
+            generateInput(data, n, d, input_seed);
+
+            PerfSample perf;
+            getrusage(RUSAGE_SELF, &usage);
+            long minor = usage.ru_minflt, major = usage.ru_majflt;
+            perfStart();
+            start = nowSeconds();
+            if (k == 0) pdqSortLarge(data, n);
+            else largeRadixSort(data, n, scratch);
+            double seconds = nowSeconds() - start;
+            perfStop(&perf);
+            getrusage(RUSAGE_SELF, &usage);
+
+            printf("| %-9s | %-9s | %12.3f | %12.4g |", k == 0 ? "pdq" : "radix", distribution_keys[d],
+                   seconds, seconds > 0 ? n / seconds : 0);
+            if (perf.valid[PERF_DTLB_MISSES]) printf(" %12lld |", perf.values[PERF_DTLB_MISSES]);
+            else printf(" %12s |", "n/a");
+            printf(" %10ld | %10ld |\n", usage.ru_minflt - minor, usage.ru_majflt - major);
+            fflush(stdout);
+
+            for (size_t i = 1; i < n; i++) {
+                if (data[i - 1] > data[i]) {
+                    fprintf(stderr, "%s produced unsorted output on %s input\n", k == 0 ? "pdq" : "radix",
+                            distribution_keys[d]);
+                    status = 2;
+                    break;
+                }
+            }
+        }
+    }
+    printf("+-----------+-----------+--------------+--------------+--------------+------------+------------+\n");
+    printf("Process peak RSS: %.1f MB\n", peakRssKB() / 1024.0);
+
+    largeFree(data, bytes);
+    largeFree(scratch, bytes);
+    return status;
+}
+
+// Batched sorting of short arrays
+
+// Length class of an n-element array: 0 up to 8 elements, then one per
+// power of two up to BATCH_MAX_LENGTH, then everything longer
+static inline int batchClass(size_t n) {
+    if (n <= 8) return 0;
+    if (n > BATCH_MAX_LENGTH) return BATCH_CLASSES - 1;
+    return 32 - __builtin_clz((unsigned)n - 1) - 3;
+}
+
+// Sort one array with the kernel of its length class: the padded sorting
+// network up to SIMD_BLOCK_SIZE, network blocks and vector merges through
+// a stack buffer up to BATCH_MAX_LENGTH, pdqsort beyond. Without AVX2 the
+// same calls fall back to insertion sort and bottom-up merge sort.
+// Arrays that are already in order are left after one scan.
+static inline void batchSortArray(int arr[], int n) {
+    int buffer[BATCH_MAX_LENGTH];
+    int i = 1;
+    while (i < n && arr[i - 1] <= arr[i]) i++;
+    if (i >= n) return;
+#ifdef HAVE_AVX2_KERNELS
+    if (n > SIMD_BLOCK_SIZE && n <= 4 * SIMD_BLOCK_SIZE && simdAvailable()) {
+        sortMediumAVX2(arr, n);
+        return;
+    }
+#endif
+    if (n <= SIMD_BLOCK_SIZE) simdSortSmall(arr, n);
+    else if (n <= BATCH_MAX_LENGTH) simdMergeSort(arr, n, buffer);
+    else pdqSort(arr, n);
+}
+
+typedef struct {
+    int *values;
+    const size_t *offsets;
+    const size_t *order;          // Array indices grouped by class, or NULL
+    const size_t *chunk_starts;   // Position in order where each chunk begins
+    size_t first_chunk, last_chunk;
+} BatchJob;
+
+static void batchChunks(void *arg) {
+    BatchJob *job = (BatchJob*)arg;
+
+    if (job->last_chunk - job->first_chunk > 1) {
+        size_t mid = job->first_chunk + (job->last_chunk - job->first_chunk) / 2;
+        BatchJob left = *job, right = *job;
+        left.last_chunk = mid;
+        right.first_chunk = mid;
+        PoolTask task;
+        poolSpawn(&task, batchChunks, &left);
+        batchChunks(&right);
+        poolWait(&task);
+        return;
+    }
+
+    for (size_t k = job->chunk_starts[job->first_chunk]; k < job->chunk_starts[job->last_chunk]; k++) {
+        size_t i = job->order ? job->order[k] : k;
+        batchSortArray(job->values + job->offsets[i], (int)(job->offsets[i + 1] - job->offsets[i]));
+    }
+}
+
+// Sort each of the count arrays values[offsets[i]..offsets[i + 1]) of a
+// CSR batch. A counting sort over length classes orders the arrays so
+// every class runs its kernel back to back (arrays keep their memory
+// order within a class); without scratch for the order the arrays are
+// sorted in place order. The order is cut into chunks of about half the
+// L2 cache, which are sorted in parallel on the thread pool.
+void sortBatch(int values[], const size_t offsets[], size_t count) {
+    if (count == 0) return;
+
+    size_t *order = NULL;
+    if (scratchFits(count * sizeof(size_t))) {
+        size_t starts[BATCH_CLASSES + 1] = {0};
+        order = (size_t*)scratchAlloc(count * sizeof(size_t));
+        for (size_t i = 0; i < count; i++) starts[batchClass(offsets[i + 1] - offsets[i]) + 1]++;
+        for (int c = 0; c < BATCH_CLASSES; c++) starts[c + 1] += starts[c];
+        for (size_t i = 0; i < count; i++) order[starts[batchClass(offsets[i + 1] - offsets[i])]++] = i;
+    }
+
+    size_t chunk_bytes = cache_sizes.l2 / 2;
+    size_t max_chunks = (offsets[count] - offsets[0]) * sizeof(int) / chunk_bytes + 2;
+    size_t *chunk_starts = (size_t*)malloc((max_chunks + 1) * sizeof(size_t));
+    size_t chunks = 0, bytes = 0;
+    chunk_starts[0] = 0;
+    for (size_t k = 0; k < count; k++) {
+        size_t i = order ? order[k] : k;
+        bytes += (offsets[i + 1] - offsets[i]) * sizeof(int);
+        if (bytes >= chunk_bytes && chunks + 1 < max_chunks) {
+            chunk_starts[++chunks] = k + 1;
+            bytes = 0;
+        }
+    }
+    if (chunk_starts[chunks] < count) chunk_starts[++chunks] = count;
+
+    BatchJob job = {values, offsets, order, chunk_starts, 0, chunks};
+    if (chunks > 1 && num_threads > 1) {
+        poolRun(batchChunks, &job, num_threads);
+    } else {
+        for (size_t c = 0; c < chunks; c++) {
+            job.first_chunk = c;
+            job.last_chunk = c + 1;
+            batchChunks(&job);
+        }
+    }
+
+    free(chunk_starts);
+    scratchFree(order);
+}
+
+// Batch benchmark (--batch): count arrays of BATCH_MIN_LENGTH to
+// BATCH_MAX_LENGTH elements in one CSR buffer, sorted by sortBatch with
+// the configured threads and with one, and by a loop calling each
+// selected algorithm once per array. Reports the median over the
+// repetitions in arrays and elements per second.
+int runBatchBenchmark(size_t count, BenchConfig *config) {
+    size_t *offsets = (size_t*)malloc((count + 1) * sizeof(size_t));
+    Xoshiro256 rng;
+    prngSeed(&rng, input_seed ^ 0xBA7C4ull);
+    offsets[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + BATCH_MIN_LENGTH + prngBounded(&rng, BATCH_MAX_LENGTH - BATCH_MIN_LENGTH + 1);
+    }
+    size_t total = offsets[count];
+    int *input = (int*)malloc(total * sizeof(int));
+    int *expected = (int*)malloc(total * sizeof(int));
+    int *work = (int*)malloc(total * sizeof(int));
+    double *samples = (double*)malloc(config->reps * sizeof(double));
+    int status = 0;
+
+    printf("%zu arrays of %d to %d elements (%zu elements), %d threads, median of %d runs\n",
+           count, BATCH_MIN_LENGTH, BATCH_MAX_LENGTH, total, num_threads, config->reps);
+    printf("+-----------------------+-----------+--------------+--------------+--------------+------------+\n");
+    printf("| Method                | Input     | Median (s)   | Arrays/s     | Elements/s   | vs batch   |\n");
+    printf("+-----------------------+-----------+--------------+--------------+--------------+------------+\n");
+
+    for (int d = 0; d < NUM_DISTRIBUTIONS; d++) {
+        if (!config->distributions[d]) continue;
+        generateInput(input, total, d, input_seed);
+        memcpy(expected, input, total * sizeof(int));
+        for (size_t i = 0; i < count; i++) {
+            introSort(expected + offsets[i], (int)(offsets[i + 1] - offsets[i]), 0);
+        }
+
+        // Method -2 is sortBatch on all threads, -1 on one, then the
+        // per-array loop over each selected algorithm
+        double batch_seconds = 0;
+        for (int method = -2; method < num_algorithms; method++) {
+            if (method >= 0 && !config->selected[method]) continue;
+            if (method == -1 && num_threads == 1) continue;
+            char label[32];
+            if (method == -2) snprintf(label, sizeof(label), "sortBatch (%d thread%s)", num_threads,
+                                       num_threads == 1 ? "" : "s");
+            else if (method == -1) snprintf(label, sizeof(label), "sortBatch (1 thread)");
+            else snprintf(label, sizeof(label), "%s per array", algorithms[method].name);
+
+            int saved_threads = num_threads;
+            if (method == -1) num_threads = 1;
+            for (int r = 0; r < config->warmup + config->reps; r++) {
+                memcpy(work, input, total * sizeof(int));
+                scratchReset(count * sizeof(size_t));
+                double start = nowSeconds();
+                if (method < 0) {
+                    sortBatch(work, offsets, count);
+                } else {
+                    for (size_t i = 0; i < count; i++) {
+                        algorithms[method].sort(work + offsets[i], (int)(offsets[i + 1] - offsets[i]));
+                    }
+                }
+                double seconds = nowSeconds() - start;
+                if (r >= config->warmup) samples[r - config->warmup] = seconds;
+            }
+            num_threads = saved_threads;
+
+            if (memcmp(work, expected, total * sizeof(int)) != 0) {
+                fprintf(stderr, "%s produced unsorted output on %s input\n", label, distribution_keys[d]);
+                status = 2;
+            }
+            double median = sampleMedian(samples, config->reps);
+            if (method == -2) batch_seconds = median;
+            printf("| %-21s | %-9s | %12.6f | %12.4g | %12.4g | %9.2fx |\n", label, distribution_keys[d],
+                   median, median > 0 ? count / median : 0, median > 0 ? total / median : 0,
+                   batch_seconds > 0 ? median / batch_seconds : 0);
+            fflush(stdout);
+        }
+    }
+    printf("+-----------------------+-----------+--------------+--------------+--------------+------------+\n");
+
+    free(samples);
+    free(work);
+    free(expected);
+    free(input);
+    free(offsets);
+    return status;
+}
+
+// External merge sort
+
+// Background writer: the caller fills one buffer while the previous one
+// is written, so output I/O overlaps with sorting and merging
+typedef struct {
+    int fd;
+    int direct;            // fd has O_DIRECT set
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    const char *pending;   // Buffer waiting to be written, or NULL
+    size_t pending_bytes;
+    int finished;
+    int failed;            // errno of the first failed write, or 0
+    unsigned long long bytes_written;
+} AsyncWriter;
+
+static int writeFully(int fd, const char *data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t written = write(fd, data, bytes);
+        if (written < 0) return 0;
+        data += written;
+        bytes -= written;
+    }
+    return 1;
+}
+
+static void *writerMain(void *arg) {
+    AsyncWriter *w = (AsyncWriter*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->pending && !w->finished) pthread_cond_wait(&w->cond, &w->lock);
+        if (!w->pending) break;
+
+        const char *data = w->pending;
+        size_t bytes = w->pending_bytes;
+        pthread_mutex_unlock(&w->lock);
+
+        // O_DIRECT needs block-sized writes; only the final tail is shorter
+        if (w->direct && bytes % DIRECT_IO_ALIGN) {
+            fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT);
+            w->direct = 0;
+        }
+        int ok = writeFully(w->fd, data, bytes);
+
+        pthread_mutex_lock(&w->lock);
+        if (!ok && !w->failed) w->failed = errno ? errno : EIO;
+        w->bytes_written += bytes;
+        w->pending = NULL;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void writerStart(AsyncWriter *w, int fd, int direct) {
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->direct = direct;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    pthread_create(&w->thread, NULL, writerMain, w);
+}
+
+// Queue a buffer once the previous one has been written. The caller must
+// not reuse this buffer until the next writerSubmit() or writerFinish().
+static void writerSubmit(AsyncWriter *w, const char *data, size_t bytes) {
+    if (bytes == 0) return;
+    pthread_mutex_lock(&w->lock);
+    while (w->pending) pthread_cond_wait(&w->cond, &w->lock);
+    w->pending = data;
+    w->pending_bytes = bytes;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Wait for outstanding writes; returns nonzero on success, or zero with
+// errno set to the write error
+static int writerFinish(AsyncWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    w->finished = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    if (w->failed) errno = w->failed;
+    return !w->failed;
+}
+
+// Sorted run stored in a temporary file, in elements
+typedef struct {
+    unsigned long long start;
+    unsigned long long count;
+} ExternalRun;
+
+// Buffered sequential reader over one run
+typedef struct {
+    int fd;
+    int element_size;
+    unsigned long long offset, end;   // Byte range still to read
+    char *buffer;
+    size_t buffer_bytes;
+    size_t pos, len;                  // Element position / count in buffer
+    long long head;                   // Current smallest element
+    int exhausted;
+    int error;                        // errno of a failed or short read, or 0
+} RunReader;
+
+static inline long long loadElement(const char *buffer, size_t index, int element_size) {
+    if (element_size == 4) return ((const int*)buffer)[index];
+    return ((const long long*)buffer)[index];
+}
+
+static inline void storeElement(char *buffer, size_t index, long long value, int element_size) {
+    if (element_size == 4) ((int*)buffer)[index] = (int)value;
+    else ((long long*)buffer)[index] = value;
+}
+
+static void runReaderAdvance(RunReader *r) {
+    if (++r->pos < r->len) {
+        r->head = loadElement(r->buffer, r->pos, r->element_size);
+        return;
+    }
+    size_t bytes = r->end - r->offset < r->buffer_bytes ? (size_t)(r->end - r->offset) : r->buffer_bytes;
+    ssize_t got;
+    do {
+        got = bytes ? pread(r->fd, r->buffer, bytes, r->offset) : 0;
+    } while (got < 0 && errno == EINTR);
+    // A run that ends early or inside an element is an error, not its end
+    if (got <= 0 || got % r->element_size) {
+        if (got < 0) r->error = errno;
+        else if (bytes > 0) r->error = EIO;
+        r->exhausted = 1;
+        return;
+    }
+    r->offset += got;
+    r->pos = 0;
+    r->len = got / r->element_size;
+    r->head = loadElement(r->buffer, 0, r->element_size);
+}
+
+// Loser tree over k readers: tree[1..k-1] hold the loser of each match and
+// tree[0] the overall winner; leaf i sits at node k + i
+static inline int readerBefore(RunReader readers[], int a, int b) {
+    if (readers[a].exhausted) return 0;
+    if (readers[b].exhausted) return 1;
+    return readers[a].head < readers[b].head || (readers[a].head == readers[b].head && a < b);
+}
+
+static int loserTreeBuild(int tree[], RunReader readers[], int k, int node) {
+    if (node >= k) return node - k;
+    int left = loserTreeBuild(tree, readers, k, 2 * node);
+    int right = loserTreeBuild(tree, readers, k, 2 * node + 1);
+    if (readerBefore(readers, left, right)) {
+        tree[node] = right;
+        return left;
+    }
+    tree[node] = left;
+    return right;
+}
+
+// Replay the matches from the winner's leaf after its head changed
+static inline void loserTreeReplay(int tree[], RunReader readers[], int k) {
+    int winner = tree[0];
+    for (int node = (winner + k) / 2; node >= 1; node /= 2) {
+        if (readerBefore(readers, tree[node], winner)) {
+            int loser = winner;
+            winner = tree[node];
+            tree[node] = loser;
+        }
+    }
+    tree[0] = winner;
+}
+
+// Temporary file in dir; unlinked right away unless path is requested
+static int createTempFile(const char *dir, char *path, size_t path_size) {
+    char local[4096];
+    char *name = path ? path : local;
+    size_t size = path ? path_size : sizeof(local);
+
+    snprintf(name, size, "%s/.sorting-methods-XXXXXX", dir);
+    int fd = mkstemp(name);
+    if (fd >= 0 && !path) unlink(name);
+    return fd;
+}
+
+// Merge runs[0..k) from in_fd into out through the loser tree. Output
+// alternates between the two out_buffers; *current is the one to fill next.
+// Returns 0 and sets errno if a run could not be read back.
+static int mergeRunGroup(int in_fd, ExternalRun runs[], int k, AsyncWriter *out,
+                          char *read_memory, size_t read_bytes, char *out_buffers[2], size_t out_bytes,
+                          int *current, int element_size) {
+    RunReader readers[EXTERNAL_MAX_FANIN];
+    int tree[EXTERNAL_MAX_FANIN];
+
+    if (k <= 0) return 1;
+    for (int i = 0; i < k; i++) {
+        readers[i].fd = in_fd;
+        readers[i].element_size = element_size;
+        readers[i].offset = runs[i].start * element_size;
+        readers[i].end = (runs[i].start + runs[i].count) * element_size;
+        readers[i].buffer = read_memory + (size_t)i * read_bytes;
+        readers[i].buffer_bytes = read_bytes;
+        readers[i].pos = readers[i].len = 0;
+        readers[i].exhausted = 0;
+        readers[i].error = 0;
+        runReaderAdvance(&readers[i]);
+    }
+    tree[0] = k == 1 ? 0 : loserTreeBuild(tree, readers, k, 1);
+
+    size_t out_capacity = out_bytes / element_size, out_fill = 0;
+    while (!readers[tree[0]].exhausted) {
+        RunReader *winner = &readers[tree[0]];
+        storeElement(out_buffers[*current], out_fill++, winner->head, element_size);
+        if (out_fill == out_capacity) {
+            writerSubmit(out, out_buffers[*current], out_fill * element_size);
+            *current = 1 - *current;
+            out_fill = 0;
+        }
+        runReaderAdvance(winner);
+        if (k > 1) loserTreeReplay(tree, readers, k);
+    }
+    if (out_fill > 0) {
+        writerSubmit(out, out_buffers[*current], out_fill * element_size);
+        *current = 1 - *current;
+    }
+    for (int i = 0; i < k; i++) {
+        if (readers[i].error) {
+            errno = readers[i].error;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void reportPhase(const char *phase, unsigned long long bytes, double seconds) {
+    printf("%-18s %12.1f MB in %9.3f s  (%9.1f MB/s)\n", phase, bytes / 1e6, seconds,
+           seconds > 0 ? bytes / 1e6 / seconds : 0);
+}
+
+// Sort a binary file of native-endian int32 or int64 values that may be
+// larger than memory. Runs of memory_budget / 3 bytes are sorted with
+// radix sort (one buffer is written in the background while the next run
+// is sorted), then merged with a loser tree of up to EXTERNAL_MAX_FANIN
+// runs per pass. The output is written to a temporary file next to the
+// destination and renamed into place, so readers never see a partial file.
+int externalSort(ExternalSortConfig *config) {
+    int width = config->element_size;
+    struct stat st;
+    double start;
+
+    int in_fd = open(config->input_path, O_RDONLY);
+    if (in_fd < 0 || fstat(in_fd, &st) != 0) {
+        perror(config->input_path);
+        return 1;
+    }
+    if (st.st_size % width) {
+        fprintf(stderr, "%s: size is not a multiple of %d bytes\n", config->input_path, width);
+        close(in_fd);
+        return 1;
+    }
+    unsigned long long total = st.st_size / width;
+
+    char dir_buffer[4096];
+    strncpy(dir_buffer, config->output_path, sizeof(dir_buffer) - 1);
+    dir_buffer[sizeof(dir_buffer) - 1] = '\0';
+    const char *dir = dirname(dir_buffer);
+
+    // Phase 1: sorted runs
+    size_t run_elements = config->memory_budget / (3 * (size_t)width);
+    if (run_elements < 1024) run_elements = 1024;
+    if (run_elements > INT_MAX) run_elements = INT_MAX;
+
+    char *input = NULL;
+    if (total > 0) {
+        input = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (input == MAP_FAILED) {
+            perror("mmap");
+            close(in_fd);
+            return 1;
+        }
+        madvise(input, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    int run_fd = createTempFile(dir, NULL, 0);
+    int max_runs = (int)((total + run_elements - 1) / run_elements);
+    ExternalRun *runs = (ExternalRun*)malloc((max_runs + 1) * sizeof(ExternalRun));
+    char *run_buffers[2];
+    char *scratch = (char*)malloc(run_elements * width);
+    run_buffers[0] = (char*)malloc(run_elements * width);
+    run_buffers[1] = (char*)malloc(run_elements * width);
+    if (run_fd < 0 || !runs || !scratch || !run_buffers[0] || !run_buffers[1]) {
+        perror(run_fd < 0 ? "temporary run file" : "run buffers");
+        if (input) munmap(input, st.st_size);
+        close(in_fd);
+        if (run_fd >= 0) close(run_fd);
+        free(runs);
+        free(scratch);
+        free(run_buffers[0]);
+        free(run_buffers[1]);
+        return 1;
+    }
+
+    AsyncWriter writer;
+    writerStart(&writer, run_fd, 0);
+    start = nowSeconds();
+    int num_runs = 0;
+    for (unsigned long long first = 0; first < total; first += run_elements) {
+        size_t count = total - first < run_elements ? (size_t)(total - first) : run_elements;
+        char *buffer = run_buffers[num_runs % 2];
+
+        memcpy(buffer, input + first * width, count * width);
+        madvise(input + (first * width & ~(unsigned long long)(DIRECT_IO_ALIGN - 1)), count * width,
+                MADV_DONTNEED);
+        if (width == 4) radixSort((int*)buffer, (int)count, 11, (int*)scratch);
+        else radixSort64((long long*)buffer, (int)count, (long long*)scratch);
+
+        writerSubmit(&writer, buffer, count * width);
+        runs[num_runs].start = first;
+        runs[num_runs].count = count;
+        num_runs++;
+    }
+    int ok = writerFinish(&writer);
+    if (!ok) perror("temporary run file");
+    reportPhase("Run generation", (unsigned long long)st.st_size, nowSeconds() - start);
+    printf("%d sorted run(s) of up to %zu elements\n", num_runs, run_elements);
+    if (input) munmap(input, st.st_size);
+    close(in_fd);
+    free(run_buffers[0]);
+    free(run_buffers[1]);
+    free(scratch);
+
+    // Phase 2: k-way merge passes until one run is left, written to the output
+    char final_path[4096];
+    int out_fd = -1;
+    int pass = 0;
+    while (ok) {
+        int last_pass = num_runs <= EXTERNAL_MAX_FANIN;
+        int fanin = last_pass ? (num_runs > 0 ? num_runs : 1) : EXTERNAL_MAX_FANIN;
+
+        // Split the budget between fanin read buffers and two write buffers
+        size_t buffer_bytes = config->memory_budget / (fanin + 2);
+        buffer_bytes -= buffer_bytes % (DIRECT_IO_ALIGN * (size_t)width);
+        if (buffer_bytes < EXTERNAL_MIN_BUFFER) buffer_bytes = EXTERNAL_MIN_BUFFER;
+        char *read_memory = (char*)malloc((size_t)fanin * buffer_bytes);
+        char *out_buffers[2] = {NULL, NULL};
+        if (!read_memory || posix_memalign((void**)&out_buffers[0], DIRECT_IO_ALIGN, buffer_bytes) != 0 ||
+            posix_memalign((void**)&out_buffers[1], DIRECT_IO_ALIGN, buffer_bytes) != 0) {
+            fprintf(stderr, "Cannot allocate %zu bytes of merge buffers\n", (fanin + 2) * buffer_bytes);
+            free(read_memory);
+            free(out_buffers[0]);
+            ok = 0;
+            break;
+        }
+
+        int next_fd;
+        if (last_pass) {
+            next_fd = createTempFile(dir, final_path, sizeof(final_path));
+            if (next_fd >= 0 && config->direct_io) {
+                fcntl(next_fd, F_SETFL, fcntl(next_fd, F_GETFL) | O_DIRECT);
+            }
+        } else {
+            next_fd = createTempFile(dir, NULL, 0);
+        }
+        if (next_fd < 0) {
+            perror("temporary file");
+            free(read_memory);
+            free(out_buffers[0]);
+            free(out_buffers[1]);
+            ok = 0;
+            break;
+        }
+
+        writerStart(&writer, next_fd, last_pass && config->direct_io);
+        start = nowSeconds();
+        int next_runs = 0, current = 0;
+        unsigned long long written = 0;
+        int read_ok = 1;
+        for (int g = 0; g < num_runs || (g == 0 && num_runs == 0); g += fanin) {
+            int k = num_runs - g < fanin ? num_runs - g : fanin;
+            unsigned long long count = 0;
+            for (int i = 0; i < k; i++) count += runs[g + i].count;
+            if (k > 0 && read_ok && !mergeRunGroup(run_fd, runs + g, k, &writer, read_memory, buffer_bytes,
+                                                   out_buffers, buffer_bytes, &current, width)) {
+                perror("temporary run file");
+                read_ok = 0;
+            }
+            runs[next_runs].start = written;
+            runs[next_runs].count = count;
+            written += count;
+            next_runs++;
+        }
+        ok = read_ok;
+        if (!writerFinish(&writer) && read_ok) {
+            perror(last_pass ? final_path : "temporary run file");
+            ok = 0;
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "Merge pass %d", ++pass);
+        reportPhase(label, 2 * written * width, nowSeconds() - start);
+
+        free(read_memory);
+        free(out_buffers[0]);
+        free(out_buffers[1]);
+        close(run_fd);
+        run_fd = next_fd;
+        num_runs = next_runs;
+        if (last_pass) {
+            out_fd = next_fd;
+            break;
+        }
+    }
+    free(runs);
+    if (out_fd < 0) {
+        close(run_fd);
+        return 1;
+    }
+
+    // Publish the output atomically, with the permissions open(O_CREAT)
+    // would have given it rather than mkstemp's 0600. Every failure has
+    // been reported by the time ok is cleared.
+    mode_t mask = umask(0);
+    umask(mask);
+    if (ok && fchmod(out_fd, 0666 & ~mask) != 0) {
+        perror(final_path);
+        ok = 0;
+    }
+    if (ok && fsync(out_fd) != 0) {
+        perror(final_path);
+        ok = 0;
+    }
+    if (close(out_fd) != 0 && ok) {
+        perror(final_path);
+        ok = 0;
+    }
+    if (ok && rename(final_path, config->output_path) != 0) {
+        perror(config->output_path);
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(final_path);
+        return 1;
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    printf("Sorted %llu elements into %s\n", total, config->output_path);
+    return 0;
+}
+
+// Streaming sort (--stream)
+
+// Chunk of parsed values. Full chunks are radix sorted by a pool task while
+// parsing continues into the next chunk.
+typedef struct {
+    char *data;
+    char *scratch;
+    size_t count;
+    int width;
+    int sorting;         // Sort task spawned and not yet waited for
+    PoolTask task;
+} StreamChunk;
+
+typedef struct {
+    StreamSortConfig *config;
+    int in_fd;
+    StreamChunk *chunks;
+    int num_chunks;
+    size_t chunk_capacity;       // Elements per chunk
+    int current;                 // Chunk being filled
+    int run_fd;                  // Spilled runs, created on first use
+    ExternalRun *runs;
+    int num_runs;
+    unsigned long long bytes_read, values;
+    double ingest_seconds;
+    int failed;
+} StreamState;
+
+// Decimal parser state carried across reads, since a number may straddle
+// two buffers
+typedef struct {
+    unsigned long long magnitude;
+    int digits;
+    int negative;
+} TextParser;
+
+static void sortStreamChunk(void *arg) {
+    StreamChunk *chunk = (StreamChunk*)arg;
+    if (chunk->width == 4) {
+        radixSort((int*)chunk->data, (int)chunk->count, chunk->count >= RADIX11_MIN_SIZE ? 11 : 8,
+                  (int*)chunk->scratch);
+    } else {
+        radixSort64((long long*)chunk->data, (int)chunk->count, (long long*)chunk->scratch);
+    }
+}
+
+// Merge every spilled run into one run in a new run file, as one
+// externalSort merge pass does. spare is an idle chunk whose scratch holds
+// the read buffers and whose data holds the two output buffers, so the
+// merge stays within the memory budget.
+static void streamMergeRuns(StreamState *s, StreamChunk *spare) {
+    int width = spare->width;
+    const char *dir = getenv("TMPDIR");
+    int next_fd = createTempFile(dir ? dir : "/tmp", NULL, 0);
+    if (next_fd < 0) {
+        perror("temporary run file");
+        s->failed = 1;
+        return;
+    }
+
+    size_t read_bytes = s->chunk_capacity / s->num_runs * width;
+    size_t out_bytes = s->chunk_capacity / 2 * width;
+    char *out_buffers[2] = {spare->data, spare->data + out_bytes};
+    int current = 0;
+    unsigned long long count = 0;
+    for (int i = 0; i < s->num_runs; i++) count += s->runs[i].count;
+
+    AsyncWriter writer;
+    writerStart(&writer, next_fd, 0);
+    int read_ok = mergeRunGroup(s->run_fd, s->runs, s->num_runs, &writer, spare->scratch, read_bytes,
+                                out_buffers, out_bytes, &current, width);
+    if (!writerFinish(&writer) || !read_ok) {
+        perror("temporary run file");
+        close(next_fd);
+        s->failed = 1;
+        return;
+    }
+    close(s->run_fd);
+    s->run_fd = next_fd;
+    s->runs[0].start = 0;
+    s->runs[0].count = count;
+    s->num_runs = 1;
+}
+
+// Hand the current chunk to the pool and make the next one available,
+// spilling its sorted contents to the run file if it still holds a run.
+// Spilled runs are merged into one once they would overflow the final
+// merge's fan-in.
+static void streamChunkFull(StreamState *s) {
+    StreamChunk *chunk = &s->chunks[s->current];
+    if (chunk->count > 0) {
+        chunk->sorting = 1;
+        poolSpawn(&chunk->task, sortStreamChunk, chunk);
+    }
+
+    s->current = (s->current + 1) % s->num_chunks;
+    chunk = &s->chunks[s->current];
+    if (chunk->count == 0) return;
+
+    if (chunk->sorting) {
+        poolWait(&chunk->task);
+        chunk->sorting = 0;
+    }
+    if (s->run_fd < 0) {
+        const char *dir = getenv("TMPDIR");
+        s->run_fd = createTempFile(dir ? dir : "/tmp", NULL, 0);
+        if (s->run_fd < 0) {
+            perror("temporary run file");
+            s->failed = 1;
+            return;
+        }
+    }
+
+    unsigned long long start = s->num_runs > 0
+        ? s->runs[s->num_runs - 1].start + s->runs[s->num_runs - 1].count : 0;
+    if (!writeFully(s->run_fd, chunk->data, chunk->count * chunk->width)) {
+        perror("temporary run file");
+        s->failed = 1;
+        return;
+    }
+    s->runs[s->num_runs].start = start;
+    s->runs[s->num_runs].count = chunk->count;
+    s->num_runs++;
+    chunk->count = 0;
+    if (s->num_runs + s->num_chunks >= EXTERNAL_MAX_FANIN) streamMergeRuns(s, chunk);
+}
+
+static inline void streamEmit(StreamState *s, long long value) {
+    StreamChunk *chunk = &s->chunks[s->current];
+    if (s->failed) return;
+    storeElement(chunk->data, chunk->count++, value, chunk->width);
+    if (chunk->count == s->chunk_capacity) streamChunkFull(s);
+}
+
+// Finish the number in progress; returns zero if it does not fit the element type
+static inline int textParserEmit(StreamState *s, TextParser *p) {
+    long long value;
+    unsigned long long limit = s->config->element_size == 4 ? (unsigned long long)INT_MAX : (unsigned long long)LLONG_MAX;
+
+    if (p->digits > 19 || p->magnitude > limit + (unsigned long long)p->negative) return 0;
+    if (p->negative) value = (long long)(0ULL - p->magnitude);
+    else value = (long long)p->magnitude;
+    streamEmit(s, value);
+    p->magnitude = 0;
+    p->digits = 0;
+    p->negative = 0;
+    return 1;
+}
+
+// Parse integers separated by any bytes other than digits and '-'
+static int parseText(StreamState *s, TextParser *p, const char *data, size_t bytes) {
+    for (const char *c = data, *end = data + bytes; c < end; c++) {
+        unsigned digit = (unsigned char)*c - '0';
+        if (digit < 10) {
+            p->magnitude = p->magnitude * 10 + digit;
+            p->digits++;
+        } else if (p->digits > 0) {
+            if (!textParserEmit(s, p)) return 0;
+            p->negative = *c == '-';
+        } else {
+            p->negative = *c == '-';
+        }
+    }
+    return 1;
+}
+
+// Root pool task: read and parse the input while other workers sort chunks
+static void streamIngest(void *arg) {
+    StreamState *s = (StreamState*)arg;
+    int width = s->config->element_size;
+    char *buffer = (char*)malloc(STREAM_IO_BUFFER + sizeof(long long));
+    size_t carry = 0;    // Bytes of a partial binary element kept from the last read
+    TextParser parser = {0, 0, 0};
+    double start = nowSeconds();
+
+    for (;;) {
+        ssize_t got = read(s->in_fd, buffer + carry, STREAM_IO_BUFFER);
+        if (got < 0) {
+            perror(s->config->input_path ? s->config->input_path : "stdin");
+            s->failed = 1;
+            break;
+        }
+        if (got == 0) break;
+        s->bytes_read += got;
+
+        if (s->config->binary) {
+            size_t total = carry + got, whole = total / width;
+            for (size_t i = 0; i < whole && !s->failed; i++) {
+                streamEmit(s, loadElement(buffer, i, width));
+            }
+            carry = total - whole * width;
+            memmove(buffer, buffer + whole * width, carry);
+        } else if (!parseText(s, &parser, buffer, got) && !s->failed) {
+            fprintf(stderr, "Value out of range for int%d\n", width * 8);
+            s->failed = 1;
+        }
+        if (s->failed) break;
+    }
+
+    if (!s->failed) {
+        if (s->config->binary && carry > 0) {
+            fprintf(stderr, "Input ends with a partial %d-byte element\n", width);
+            s->failed = 1;
+        } else if (!s->config->binary && parser.digits > 0 && !textParserEmit(s, &parser)) {
+            fprintf(stderr, "Value out of range for int%d\n", width * 8);
+            s->failed = 1;
+        }
+    }
+    s->ingest_seconds = nowSeconds() - start;
+
+    // Sort the last partial chunk and wait for every outstanding sort
+    StreamChunk *last = &s->chunks[s->current];
+    if (!s->failed && last->count > 0) {
+        last->sorting = 1;
+        poolSpawn(&last->task, sortStreamChunk, last);
+    }
+    for (int i = 0; i < s->num_chunks; i++) {
+        if (s->chunks[i].sorting) {
+            poolWait(&s->chunks[i].task);
+            s->chunks[i].sorting = 0;
+        }
+    }
+    free(buffer);
+}
+
+// Append value to out as decimal text followed by a newline
+static inline size_t formatInteger(char *out, long long value) {
+    char digits[24];
+    int len = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[len++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    size_t pos = 0;
+    if (value < 0) out[pos++] = '-';
+    while (len > 0) out[pos++] = digits[--len];
+    out[pos++] = '\n';
+    return pos;
+}
+
+// Sort integers from a file or stdin and write them to a file or stdout.
+// Parsing, chunk sorting on the pool workers and spilling overlap; the
+// final loser-tree merge starts once the input ends. Statistics go to
+// stderr so the sorted output can be piped on.
+int streamSort(StreamSortConfig *config) {
+    int width = config->element_size;
+    StreamState s;
+    memset(&s, 0, sizeof(s));
+    s.config = config;
+    s.run_fd = -1;
+    double start = nowSeconds();
+
+    s.in_fd = STDIN_FILENO;
+    if (config->input_path && strcmp(config->input_path, "-") != 0) {
+        s.in_fd = open(config->input_path, O_RDONLY);
+        if (s.in_fd < 0) {
+            perror(config->input_path);
+            return 1;
+        }
+        posix_fadvise(s.in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    int out_fd = STDOUT_FILENO;
+    if (config->output_path) {
+        out_fd = open(config->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            perror(config->output_path);
+            return 1;
+        }
+    }
+
+    // Chunks and their radix scratch share the memory budget. One chunk per
+    // thread can be sorting while another is filled and one is spilled; the
+    // merges reuse scratch memory for their read buffers. The chunk count is
+    // kept to half the merge fan-in, and cut before chunks get smaller than
+    // STREAM_MIN_CHUNK, so fewer threads sort at once on a small budget.
+    size_t budget_chunks = config->memory_budget / (2 * (size_t)STREAM_MIN_CHUNK * width);
+    s.num_chunks = num_threads + 2;
+    if (s.num_chunks > EXTERNAL_MAX_FANIN / 2) s.num_chunks = EXTERNAL_MAX_FANIN / 2;
+    if ((size_t)s.num_chunks > budget_chunks) s.num_chunks = budget_chunks > 3 ? (int)budget_chunks : 3;
+    s.chunk_capacity = config->memory_budget / (2 * (size_t)s.num_chunks * width);
+    if (s.chunk_capacity < STREAM_MIN_CHUNK) {
+        s.chunk_capacity = STREAM_MIN_CHUNK;
+        fprintf(stderr, "Warning: --memory=%zu is below the minimum for streaming; using %.1f MB\n",
+                config->memory_budget >> 20, 2.0 * s.num_chunks * s.chunk_capacity * width / (1 << 20));
+    }
+    if (s.chunk_capacity > INT_MAX) s.chunk_capacity = INT_MAX;
+    s.chunks = (StreamChunk*)calloc(s.num_chunks, sizeof(StreamChunk));
+    for (int i = 0; i < s.num_chunks; i++) {
+        s.chunks[i].data = (char*)malloc(s.chunk_capacity * width);
+        s.chunks[i].scratch = (char*)malloc(s.chunk_capacity * width);
+        s.chunks[i].width = width;
+    }
+    s.runs = (ExternalRun*)malloc(EXTERNAL_MAX_FANIN * sizeof(ExternalRun));
+
+    poolRun(streamIngest, &s, num_threads);
+    if (s.in_fd != STDIN_FILENO) close(s.in_fd);
+    double merge_start = nowSeconds();
+
+    // Merge spilled runs (read back in buffered pieces) with the chunks
+    // still in memory, which are read in place. Every sort has finished,
+    // so the radix scratch is released to make room for the read buffers.
+    RunReader readers[EXTERNAL_MAX_FANIN];
+    int tree[EXTERNAL_MAX_FANIN];
+    int k = 0;
+    char *read_memory = NULL;
+    size_t read_bytes = 0;
+    for (int i = 0; i < s.num_chunks; i++) {
+        free(s.chunks[i].scratch);
+        s.chunks[i].scratch = NULL;
+    }
+    if (!s.failed && s.num_runs > 0) {
+        read_bytes = config->memory_budget / (4 * (size_t)s.num_runs);
+        read_bytes -= read_bytes % width;
+        if (read_bytes < EXTERNAL_MIN_BUFFER) read_bytes = EXTERNAL_MIN_BUFFER;
+        read_memory = (char*)malloc((size_t)s.num_runs * read_bytes);
+    }
+    for (int i = 0; !s.failed && i < s.num_runs; i++, k++) {
+        RunReader *r = &readers[k];
+        r->fd = s.run_fd;
+        r->element_size = width;
+        r->offset = s.runs[i].start * width;
+        r->end = (s.runs[i].start + s.runs[i].count) * width;
+        r->buffer = read_memory + (size_t)i * read_bytes;
+        r->buffer_bytes = read_bytes;
+        r->pos = r->len = 0;
+        r->exhausted = 0;
+        r->error = 0;
+        runReaderAdvance(r);
+    }
+    for (int i = 0; !s.failed && i < s.num_chunks; i++) {
+        if (s.chunks[i].count == 0) continue;
+        RunReader *r = &readers[k++];
+        r->fd = -1;
+        r->element_size = width;
+        r->offset = r->end = 0;
+        r->buffer = s.chunks[i].data;
+        r->buffer_bytes = 0;
+        r->pos = 0;
+        r->len = s.chunks[i].count;
+        r->head = loadElement(r->buffer, 0, width);
+        r->exhausted = 0;
+        r->error = 0;
+    }
+
+    AsyncWriter writer;
+    char *out_buffers[2] = {(char*)malloc(STREAM_IO_BUFFER), (char*)malloc(STREAM_IO_BUFFER)};
+    int current = 0;
+    size_t out_fill = 0;
+    writerStart(&writer, out_fd, 0);
+    if (k > 0) {
+        tree[0] = k == 1 ? 0 : loserTreeBuild(tree, readers, k, 1);
+        while (!readers[tree[0]].exhausted) {
+            RunReader *winner = &readers[tree[0]];
+            if (config->binary) {
+                storeElement(out_buffers[current], out_fill / width, winner->head, width);
+                out_fill += width;
+            } else {
+                out_fill += formatInteger(out_buffers[current] + out_fill, winner->head);
+            }
+            if (out_fill > STREAM_IO_BUFFER - 32) {
+                writerSubmit(&writer, out_buffers[current], out_fill);
+                current = 1 - current;
+                out_fill = 0;
+            }
+            s.values++;
+            runReaderAdvance(winner);
+            if (k > 1) loserTreeReplay(tree, readers, k);
+        }
+    }
+    for (int i = 0; i < k; i++) {
+        if (readers[i].error) {
+            errno = readers[i].error;
+            perror("temporary run file");
+            s.failed = 1;
+            break;
+        }
+    }
+    writerSubmit(&writer, out_buffers[current], out_fill);
+    if (!writerFinish(&writer)) {
+        perror(config->output_path ? config->output_path : "stdout");
+        s.failed = 1;
+    }
+    if (out_fd != STDOUT_FILENO && close(out_fd) != 0) {
+        perror(config->output_path);
+        s.failed = 1;
+    }
+    double end = nowSeconds();
+
+    if (!s.failed) {
+        fprintf(stderr, "Sorted %llu values from %.1f MB of %s input in %.3f s\n", s.values,
+                s.bytes_read / 1e6, config->binary ? "binary" : "text", end - start);
+        fprintf(stderr, "Ingest: %.3f s (%.2f GB/s), merge and output: %.3f s, %d run(s) spilled\n",
+                s.ingest_seconds, s.ingest_seconds > 0 ? s.bytes_read / 1e9 / s.ingest_seconds : 0,
+                end - merge_start, s.num_runs);
+    }
+
+    for (int i = 0; i < s.num_chunks; i++) {
+        free(s.chunks[i].data);
+        free(s.chunks[i].scratch);
+    }
+    free(s.chunks);
+    free(s.runs);
+    free(read_memory);
+    free(out_buffers[0]);
+    free(out_buffers[1]);
+    if (s.run_fd >= 0) close(s.run_fd);
+    return s.failed ? 1 : 0;
+}
+
+// Operation trace recording and replay
+
+// Recorder state: two preallocated buffers are filled alternately while the
+// background writer spills the other one to an unlinked temporary file
+typedef struct {
+    TraceEvent *buffers[2];
+    int current;
+    int fd;
+    int n;
+    int *initial;                   // Array contents when recording started
+    unsigned long long events;      // Events spilled so far
+    AsyncWriter writer;
+} TraceRecorder;
+
+static TraceRecorder trace;
+
+// Start recording operations on arr[0..n-1]; returns nonzero on success
+int traceBegin(const int arr[], int n) {
+    const char *dir = getenv("TMPDIR");
+    memset(&trace, 0, sizeof(trace));
+    trace.fd = createTempFile(dir ? dir : "/tmp", NULL, 0);
+    if (trace.fd < 0) {
+        perror("trace file");
+        return 0;
+    }
+    trace.n = n;
+    trace.initial = (int*)malloc(n * sizeof(int));
+    trace.buffers[0] = (TraceEvent*)malloc(TRACE_BUFFER_EVENTS * sizeof(TraceEvent));
+    trace.buffers[1] = (TraceEvent*)malloc(TRACE_BUFFER_EVENTS * sizeof(TraceEvent));
+    memcpy(trace.initial, arr, n * sizeof(int));
+    writerStart(&trace.writer, trace.fd, 0);
+
+    trace_events = trace.buffers[0];
+    trace_fill = 0;
+    return 1;
+}
+
+// Hand the full buffer to the writer and continue in the other one
+void traceSpill() {
+    writerSubmit(&trace.writer, (const char*)trace_events, trace_fill * sizeof(TraceEvent));
+    trace.events += trace_fill;
+    trace.current ^= 1;
+    trace_events = trace.buffers[trace.current];
+    trace_fill = 0;
+}
+
+// Stop recording; returns nonzero if the whole trace reached the file
+int traceEnd() {
+    traceSpill();
+    trace_events = NULL;
+    int ok = writerFinish(&trace.writer);
+    free(trace.buffers[0]);
+    free(trace.buffers[1]);
+    return ok;
+}
+
+void traceRelease() {
+    free(trace.initial);
+    close(trace.fd);
+}
+
+static void applyTraceEvent(int state[], const TraceEvent *e, int forward) {
+    if (e->op == TRACE_OP_SWAP) {
+        int temp = state[e->a];
+        state[e->a] = state[e->b];
+        state[e->b] = temp;
+    } else if (e->op == TRACE_OP_WRITE) {
+        state[e->a] = forward ? e->b : e->old;
+    }
+}
+
+// Drive the terminal renderer from the recorded trace. On a terminal the
+// keys scrub through it: space pauses, +/- change speed, r reverses,
+// left/right (or h/l) jump 1% of the trace, 0 and e go to either end and
+// q quits. Otherwise the trace simply plays through once.
+void replayTrace(const char *title, int color) {
+    unsigned long long total = trace.events;
+    const TraceEvent *events = NULL;
+    if (total > 0) {
+        events = (const TraceEvent*)mmap(NULL, total * sizeof(TraceEvent), PROT_READ, MAP_PRIVATE, trace.fd, 0);
+        if (events == MAP_FAILED) {
+            perror("trace replay");
+            return;
+        }
+    }
+
+    int n = trace.n;
+    int *state = (int*)malloc(n * sizeof(int));
+    memcpy(state, trace.initial, n * sizeof(int));
+
+    // visualization_speed is the delay per event, but a long trace plays in
+    // at most REPLAY_MAX_SECONDS unless slowed down by hand
+    double rate = visualization_speed > 0 ? 1e6 / visualization_speed : (double)total;
+    if (rate < total / (double)REPLAY_MAX_SECONDS) rate = total / (double)REPLAY_MAX_SECONDS;
+    if (rate < 1) rate = 1;
+
+    int interactive = isatty(STDIN_FILENO);
+    struct termios saved;
+    if (interactive) {
+        struct termios raw;
+        tcgetattr(STDIN_FILENO, &saved);
+        raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    unsigned long long pos = 0;
+    int direction = 1, paused = 0, quit = 0;
+    double carry = 0;
+    double frame_interval = visualization_fps > 0 ? 1.0 / visualization_fps : 0;
+    double last = nowSeconds();
+    visualizeBegin(n);
+
+    while (!quit) {
+        long long target = pos;
+        int key_pressed = 0;
+
+        if (interactive) {
+            struct timeval timeout = {0, (long)(frame_interval * 1e6)};
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(STDIN_FILENO, &fds);
+            char keys[16];
+            ssize_t got = select(STDIN_FILENO + 1, &fds, NULL, NULL, &timeout) > 0
+                              ? read(STDIN_FILENO, keys, sizeof(keys)) : 0;
+            long long jump = total / 100 > 0 ? (long long)(total / 100) : 1;
+            for (ssize_t k = 0; k < got; k++) {
+                key_pressed = 1;
+                switch (keys[k]) {
+                    case ' ': paused = !paused; break;
+                    case '+': case '=': rate *= 2; break;
+                    case '-': if (rate > 1) rate /= 2; break;
+                    case 'r': direction = -direction; break;
+                    case 'l': case 'C': target += jump; break;   // 'C'/'D' end arrow sequences
+                    case 'h': case 'D': target -= jump; break;
+                    case '0': target = 0; break;
+                    case 'e': target = total; break;
+                    case 'q': quit = 1; break;
+                }
+            }
+        } else if (frame_interval > 0) {
+            usleep((useconds_t)(frame_interval * 1e6));
+        }
+
+        double now = nowSeconds();
+        if (!paused) {
+            carry += rate * (now - last) * direction;
+            long long steps = (long long)carry;
+            carry -= steps;
+            target += steps;
+        }
+        last = now;
+        if (target < 0) target = 0;
+        if (target > (long long)total) target = total;
+
+        // Step the array state to the target event in either direction
+        int index1 = -1, index2 = -1;
+        viz.steps = (int)(target > (long long)pos ? target - pos : pos - target);
+        while ((long long)pos < target) {
+            applyTraceEvent(state, &events[pos], 1);
+            index1 = events[pos].a;
+            index2 = events[pos].op == TRACE_OP_WRITE ? -1 : events[pos].b;
+            pos++;
+        }
+        while ((long long)pos > target) {
+            pos--;
+            applyTraceEvent(state, &events[pos], 0);
+            index1 = events[pos].a;
+            index2 = events[pos].op == TRACE_OP_WRITE ? -1 : events[pos].b;
+        }
+
+        if (viz.steps > 0 || key_pressed || viz.frames == 0) {
+            drawFrame(state, n, index1, index2, title, color);
+            printf("event %llu / %llu | %.0f events/s %s| %s" "\x1b[K\n", pos, total, rate,
+                   direction > 0 ? "" : "(reverse) ", paused ? "paused" : "playing");
+            if (interactive) {
+                printf("space pause, +/- speed, r reverse, h/l or arrows scrub, 0/e ends, q quit\x1b[K\n");
+            }
+        }
+
+        // Playback stops at either end; on a terminal it waits for a key
+        if ((direction > 0 && pos == total) || (direction < 0 && pos == 0)) {
+            if (!interactive) break;
+            paused = 1;
+        }
+    }
+
+    fflush(stdout);
+    if (interactive) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    free(state);
+    if (events) munmap((void*)events, total * sizeof(TraceEvent));
+}
+
+// Record one of the visualization mode's sorts at full speed, then replay it
+void visualizeAlgorithm(int algorithm, int arr[], int n) {
+    static const char *titles[] = {"SELECTION SORT", "BUBBLE SORT", "MERGE SORT", "QUICK SORT"};
+    int visualize = visualize_enabled;
+
+#ifdef NO_TRACE
+    printf("Tracing is compiled out (built with -DNO_TRACE)\n");
+    visualize = 0;
+#endif
+    if (visualize && !traceBegin(arr, n)) visualize = 0;
+
+    double start = nowSeconds();
+    switch (algorithm) {
+        case 1: selectionSort(arr, n, visualize); break;
+        case 2: bubbleSort(arr, n, visualize); break;
+        case 3: mergeSort(arr, 0, n - 1, visualize); break;
+        case 4: quickSort(arr, 0, n - 1, visualize); break;
+    }
+    double elapsed = nowSeconds() - start;
+    if (!visualize) return;
+
+    int ok = traceEnd();
+    printf("Recorded %llu events (%.1f MB) in %.3f seconds\n", trace.events,
+           trace.events * sizeof(TraceEvent) / 1e6, elapsed);
+    if (ok) {
+        char title[64];
+        snprintf(title, sizeof(title), "%s - REPLAY", titles[algorithm - 1]);
+        replayTrace(title, algorithm);
+    } else {
+        printf("Could not write the trace file\n");
+    }
+    traceRelease();
+}
+
+// Uniform entry points for the comparison and performance analysis modes
+void runSelectionSort(int arr[], int n) { selectionSort(arr, n, 0); }
+void runBubbleSort(int arr[], int n)    { bubbleSort(arr, n, 0); }
+void runMergeSort(int arr[], int n) {
+    if (scratchFits(n * sizeof(int))) mergeSort(arr, 0, n - 1, 0);
+    else inPlaceMergeSort(arr, n);
 }
+void runQuickSort(int arr[], int n)     { quickSort(arr, 0, n - 1, 0); }
+void runIntroSort(int arr[], int n)     { introSort(arr, n, 0); }
+void runBottomUpMergeSort(int arr[], int n) { bottomUpMergeSort(arr, n, NULL); }
+void runParallelMergeSort(int arr[], int n) { parallelMergeSort(arr, n, num_threads); }
+void runParallelQuickSort(int arr[], int n) { parallelQuickSort(arr, n, num_threads); }
+void runCountingSort(int arr[], int n)  { countingSort(arr, n); }
+void runRadixSort(int arr[], int n)     { radixSort(arr, n, n >= RADIX11_MIN_SIZE ? 11 : 8, NULL); }
+void runRadixSort11(int arr[], int n)   { radixSort(arr, n, 11, NULL); }
+void runSimdMergeSort(int arr[], int n) { simdMergeSort(arr, n, NULL); }
+void runTimSort(int arr[], int n)       { timSort(arr, n, NULL); }
+void runPdqSort(int arr[], int n)       { pdqSort(arr, n); }
+void runMultiwayMergeSort(int arr[], int n) { multiwayMergeSort(arr, n, NULL); }